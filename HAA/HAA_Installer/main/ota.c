@@ -78,6 +78,42 @@ static WOLFSSL_CTX* ctx = NULL;
 static char last_host[HOST_LEN];
 static char last_location[LOCATION_LEN];
 
+// SHA-384 of firmware is computed while it is downloaded, and kept across resumed downloads
+static Sha384 ota_sha, ota_sha_checkpoint;
+static int ota_sha_sector = 0;
+static int ota_sha_collected = -1;              // Hashed bytes, or -1 if stream hash is not valid
+static int ota_sha_checkpoint_collected = -1;
+
+static void ota_sha_sync(const int collected) {
+    if (ota_sha_collected != collected) {
+        if (ota_sha_checkpoint_collected == collected) {
+            // Download was rolled back to last checkpoint
+            memcpy(&ota_sha, &ota_sha_checkpoint, sizeof(ota_sha));
+            ota_sha_collected = collected;
+        } else {
+            ota_sha_collected = -1;
+        }
+    }
+}
+
+static void ota_sha_set_checkpoint(const int collected) {
+    ota_sha_sync(collected);
+    
+    if (ota_sha_collected >= 0) {
+        memcpy(&ota_sha_checkpoint, &ota_sha, sizeof(ota_sha));
+        ota_sha_checkpoint_collected = collected;
+    }
+}
+
+static void ota_sha_update(const int collected, uint8_t* data, const int len) {
+    ota_sha_sync(collected);
+    
+    if (ota_sha_collected >= 0) {
+        wc_Sha384Update(&ota_sha, data, len);
+        ota_sha_collected += len;
+    }
+}
+
 #ifdef DEBUG_WOLFSSL
 void MyLoggingCallback(const int logLevel, const char* const logMessage) {
     /*custom logging function*/
@@ -513,6 +549,17 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
         return -5;      // Needs to be either a sector or a signature/version file
     }
     
+    if (sector) {
+        if (collected == 0) {
+            wc_InitSha384(&ota_sha);
+            ota_sha_sector = sector;
+            ota_sha_collected = 0;
+            ota_sha_checkpoint_collected = -1;
+        } else if (ota_sha_sector != sector) {
+            ota_sha_collected = -1;
+        }
+    }
+    
     unsigned int connection_tries = 0;
     while ((ota_conn_result = ota_get_final_location(repo, file, port, is_ssl)) <= 0 && connection_tries < 3) {
         connection_tries++;
@@ -569,6 +616,10 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
             last_collected = collected;
             writespace = 0;
             
+            if (sector) {
+                ota_sha_set_checkpoint(collected);
+            }
+            
             snprintf(recv_buf, RECV_BUF_LEN - 1, REQUESTHEAD"%s"REQUESTTAIL"%s"RANGE"%d-%d%s", last_location, last_host, collected, collected + 4095, CRLFCRLF);
             
             const unsigned int send_bytes = strlen(recv_buf);
@@ -696,6 +747,7 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
                                     }
                                 }
                                 writespace -= ret;
+                                ota_sha_update(collected, (uint8_t*) recv_buf, ret);
                             } else { // Buffer
                                 if (ret > bufsz) {
                                     free(recv_buf);
@@ -772,6 +824,10 @@ static int ota_get_file_ex(char* repo, char* file, int sector, uint8_t* buffer,
         ;
     }
     
+    if (sector) {
+        ota_sha_sync(collected);
+    }
+    
     if (resume) {
         *resume = collected;
     }
@@ -827,41 +883,51 @@ int ota_get_sign(char* repo, char* file, uint8_t* signature, uint16_t port, bool
 int ota_verify_sign(int start_sector, int filesize, uint8_t* signature) {
     INFO(">>> Verify");
     
-    int bytes;
     uint8_t hash[HASHSIZE];
-    uint8_t* buffer = malloc(1024);
     Sha384 sha;
     
-    wc_InitSha384(&sha);
+    ota_sha_sync(filesize);
+    
+    if (ota_sha_sector == start_sector && ota_sha_collected == filesize) {
+        INFO("Stream hash");
+        memcpy(&sha, &ota_sha, sizeof(sha));
+    } else {
+        int bytes;
+        uint8_t* buffer = malloc(1024);
+        
+        wc_InitSha384(&sha);
 
-    for (bytes = 0; bytes < filesize - 1024; bytes += 1024) {
+        for (bytes = 0; bytes < filesize - 1024; bytes += 1024) {
 #ifdef ESP_PLATFORM
-        if (esp_partition_read(get_partition(start_sector), bytes, buffer, 1024) != ESP_OK) {
+            if (esp_partition_read(get_partition(start_sector), bytes, buffer, 1024) != ESP_OK) {
 #else
-        if (!spiflash_read(start_sector + bytes, buffer, 1024)) {
+            if (!spiflash_read(start_sector + bytes, buffer, 1024)) {
 #endif
-            ERROR("Read flash");
-            break;
-        }
-        
-        if (bytes == 0) {
-            buffer[0] = file_first_byte[0];
+                ERROR("Read flash");
+                break;
+            }
+            
+            if (bytes == 0) {
+                buffer[0] = file_first_byte[0];
+            }
+            
+            wc_Sha384Update(&sha, buffer, 1024);
         }
         
-        wc_Sha384Update(&sha, buffer, 1024);
-    }
-    
 #ifdef ESP_PLATFORM
-    if (esp_partition_read(get_partition(start_sector), bytes, buffer, filesize - bytes) != ESP_OK) {
+        if (esp_partition_read(get_partition(start_sector), bytes, buffer, filesize - bytes) != ESP_OK) {
 #else
-    if (!spiflash_read(start_sector + bytes, buffer, filesize - bytes)) {
+        if (!spiflash_read(start_sector + bytes, buffer, filesize - bytes)) {
 #endif
-        ERROR("Read flash");
+            ERROR("Read flash");
+        }
+        
+        wc_Sha384Update(&sha, buffer, filesize - bytes);
+        
+        free(buffer);
     }
     
-    wc_Sha384Update(&sha, buffer, filesize - bytes);
-    
-    free(buffer);
+    ota_sha_collected = -1;
     
     wc_Sha384Final(&sha, hash);
     
@@ -850,6 +850,10 @@ static void wifi_config_server_on_settings_update_task(void* args) {
                 }
             }
             
+            sysparam_erase(LAST_STATES_SNAPSHOT_SYSPARAM_A);
+            sysparam_erase(LAST_STATES_SNAPSHOT_SYSPARAM_B);
+            sysparam_erase(CONFIG_CACHE_SYSPARAM);
+            
             if (conf_param && conf_param->value) {
                 sysparam_set_string(HAA_SCRIPT_SYSPARAM, conf_param->value);
             } else {
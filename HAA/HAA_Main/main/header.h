@@ -33,7 +33,7 @@
 #define AUTODIMMER_TASK_SIZE                GLOBAL_TASK_SIZE
 #define IRRF_TX_TASK_SIZE                   (TASK_SIZE_FACTOR * (456))
 #define UART_ACTION_TASK_SIZE               (TASK_SIZE_FACTOR * (384))
-#define NETWORK_ACTION_TASK_SIZE            (TASK_SIZE_FACTOR * (544))
+#define NETWORK_ACTION_TASK_SIZE            (TASK_SIZE_FACTOR * (640))
 #define TEMPERATURE_TASK_SIZE               GLOBAL_TASK_SIZE
 #define PROCESS_TH_TASK_SIZE                GLOBAL_TASK_SIZE
 #define PROCESS_HUMIDIF_TASK_SIZE           GLOBAL_TASK_SIZE
@@ -72,6 +72,28 @@
 #define REBOOT_TASK_PRIORITY                (tskIDLE_PRIORITY + 3)
 #define IRRF_CAPTURE_TASK_PRIORITY          (configMAX_PRIORITIES - 2)
 
+// Action Workers
+#define ACTION_WORKER_NETWORK               (0)
+#define ACTION_WORKER_IRRF_TX               (1)
+#define ACTION_WORKER_UART                  (2)
+#define ACTION_WORKER_TYPES                 (3)
+
+#define ACTION_WORKER_QUEUE_SIZE            (8)     // Pending jobs by worker type
+#define NETWORK_ACTION_WORKERS              (1)     // Max concurrent jobs by worker type
+#define IRRF_TX_WORKERS                     (1)
+#define UART_ACTION_WORKERS                 (1)
+
+#define INCHING_TIMERS_BY_OUTPUT            (2)     // Pending inching timers in pool by binary output with inching
+
+#define POLL_TIMER_RESOLUTION_MS            (100)   // Timer wheel used by sensor polling, same as TH_SENSOR_POLL_PERIOD_MIN
+
+// Polling scheduler
+#define POLL_SCHEDULER_SLOTS                (60)    // Slots in a cycle of POLL_SCHEDULER_SLOTS * POLL_SCHEDULER_SLOT_MS
+#define POLL_SCHEDULER_SLOT_MS              (500)
+#define POLL_SCHEDULER_JITTER_MS            (200)   // Random extra phase by poller, 0 to disable
+#define POLL_SCHEDULER_RETRY_MS             (300)   // Delay to retry a poller when POLL_TASKS_MAX are running
+#define POLL_TASKS_MAX                      (2)     // Max concurrent sensor tasks started by pollers
+
 // Button Events
 #define SINGLEPRESS_EVENT                   (0)
 #define DOUBLEPRESS_EVENT                   (1)
@@ -573,6 +595,19 @@
 #define FM_MATHS_OPERATION_ABS              (12)
 #define FM_MATHS_OPERATION_EMA_LPFILTER     (13)
 #define FM_MATHS_OPERATION_EMA_HPFILTER     (14)
+#define FM_MATHS_OPERATION_MIN              (15)
+#define FM_MATHS_OPERATION_MAX              (16)
+#define FM_MATHS_OPERATION_WINDOW_MIN       (17)
+#define FM_MATHS_OPERATION_WINDOW_MAX       (18)
+#define FM_MATHS_OPERATION_WINDOW_AVG       (19)
+#define FM_MATHS_OPERATION_WINDOW_MEDIAN    (20)
+#define FM_MATHS_OPERATION_WINDOW_STDDEV    (21)
+#define FM_MATHS_WINDOW_SIZE_MAX            (60)
+#define FM_MATHS_SOURCE_CONSTANT            (0)
+#define FM_MATHS_SOURCE_FLOAT               (1)
+#define FM_MATHS_SOURCE_INT                 (2)
+#define FM_MATHS_SOURCE_BOOL                (3)
+#define FM_MATHS_SOURCE_NONE                (4)
 #define FM_MATHS_GET_TIME_HOUR              (-1)
 #define FM_MATHS_GET_TIME_MINUTE            (-2)
 #define FM_MATHS_GET_TIME_SECOND            (-3)
@@ -668,7 +703,7 @@
 
 #define HIST_DATA_ARRAY_SET                 "h"
 #define HIST_READ_ON_CLOCK_READY_SET        "x"
-#define HIST_LAST_REGISTER                  ch_group->num_f[0]
+#define HIST_LAST_REGISTER                  ch_group->num_f[0]     // Only raw blocks, compressed ones use data_history_t encoder
 #define HIST_SERVICE                        ch_group->num_f[1]
 #define HIST_CH                             ch_group->num_i[0]
 #define HIST_TIME_SIZE                      (4)     // (sizeof(uint32_t))
@@ -676,11 +711,25 @@
 #define HIST_REGISTER_SIZE                  (HIST_TIME_SIZE + HIST_DATA_SIZE)
 #define HIST_REGISTERS_BY_BLOCK             (100)
 #define HIST_BLOCK_SIZE                     (HIST_REGISTERS_BY_BLOCK * HIST_REGISTER_SIZE)
+#define HIST_COMPRESSED_BLOCK_SIZE          (400)   // Half RAM of raw block. About 80 on/off, 140 power or 330 temperature registers
+#define HIST_FLASH_SET                      "hf"
+#define HIST_COMPRESSED_SET                 "hc"
+#define HIST_FLASH_MIN_SECTOR               (0x100)     // ESP8266: first 1MB is used by firmware, sysparam and SDK data
 
 #define AUTOOFF_TIMER                       ch_group->timer2
 
 #define MAX_ACTIONS                         (51)    // from 0 to (MAX_ACTIONS - 1)
 #define MAX_WILDCARD_ACTIONS                (4)     // from 0 to (MAX_WILDCARD_ACTIONS - 1)
+#define ACTION_TYPE_COPY                    (0)     // Action table types, same order as ch_group_t lists
+#define ACTION_TYPE_BINARY_OUTPUT           (1)
+#define ACTION_TYPE_SERV_MANAGER            (2)
+#define ACTION_TYPE_SYSTEM                  (3)
+#define ACTION_TYPE_NETWORK                 (4)
+#define ACTION_TYPE_IRRF_TX                 (5)
+#define ACTION_TYPE_UART                    (6)
+#define ACTION_TYPE_PWM                     (7)
+#define ACTION_TYPE_SET_CH                  (8)
+#define ACTION_TYPES                        (9)
 #define WILDCARD_ACTIONS_ARRAY_HEADER       "y"
 #define NO_LAST_WILDCARD_ACTION             (-1000000.f)
 #define WILDCARD_ACTIONS                    "0"
@@ -732,6 +781,15 @@
 #define NETWORK_ACTION_CONTENT              "c"
 #define NETWORK_ACTION_WAIT_RESPONSE_SET    "w"
 #define NETWORK_ACTION_WILDCARD_VALUE       "#HAA@"
+#define NETWORK_ACTION_WILDCARD_LEN         (9)     // "#HAA@" + 2 digits service + 2 digits characteristic
+#define NETWORK_ACTION_VALUE_LEN            (15)
+#define NETWORK_ACTION_STREAM_BUFFER        (256)   // Stack buffer used to stream requests to socket
+#define NETWORK_CON_POOL_SIZE               (2)     // Kept alive HTTP connections of network actions, 0 to disable
+#define NETWORK_CON_IDLE_MS                 (4000)  // Lower than usual keep-alive timeout of servers
+#define NETWORK_CON_PIPELINE_MAX            (4)     // Requests sent to a connection before reading their responses
+#define NETWORK_CON_LINE_LEN                (24)    // Only start of response headers is needed
+#define NETWORK_DNS_CACHE_SIZE              (4)
+#define NETWORK_DNS_CACHE_TTL_MS            (300000)
 #define SYSTEM_ACTION_REBOOT                (0)
 #define SYSTEM_ACTION_SETUP_MODE            (1)
 #define SYSTEM_ACTION_OTA_UPDATE            (2)
@@ -831,6 +889,26 @@
 #define STATUS_LED_DURATION_OFF             (120)
 
 #define SAVE_STATES_DELAY_MS                (3000)
+
+// With snapshot, per key states are only read as legacy and erased. Snapshot is saved
+// with sysparam_set_batch(), together with erasing legacy keys. Per key batch
+// save_states() is only built with HAA_DISABLE_LAST_STATES_SNAPSHOT
+#ifndef HAA_DISABLE_LAST_STATES_SNAPSHOT
+#define LAST_STATES_SNAPSHOT
+#endif
+#define LAST_STATES_SNAPSHOT_VERSION        (2)
+#define LAST_STATES_SNAPSHOT_VERSION_1      (1)     // 1 byte value length, only read
+#define LAST_STATES_SNAPSHOT_HEADER_SIZE    (8)
+#define LAST_STATES_SNAPSHOT_ENTRY_SIZE     (5)
+#define LAST_STATES_SNAPSHOT_ENTRY_SIZE_1   (4)
+#define LAST_STATES_SNAPSHOT_CRC_SIZE       (4)
+
+#ifndef HAA_DISABLE_CONFIG_CACHE
+#define CONFIG_CACHE
+#endif
+#define CONFIG_CACHE_HEADER_SIZE            (8)
+#define CONFIG_CACHE_MIN_FREE_SIZE          (2048)  // Sysparam space kept for states and settings
+
 #define RANDOM_DELAY_MS                     (3000)
 
 #define HOMEKIT_RE_PAIR_TIME_MS             (300000)
@@ -72,6 +72,8 @@
 #endif
 
 #include <math.h>
+#include <stddef.h>
+#include <limits.h>
 
 #include <lwip/err.h>
 #include <lwip/sockets.h>
@@ -98,6 +100,8 @@
 #include <unistring.h>
 #include <adv_i2c.h>
 #include <adv_pwm.h>
+#include <hist_flash.h>
+#include <hist_block.h>
 
 #include "setup.h"
 #include "ir_code.h"
@@ -151,6 +155,7 @@ main_config_t main_config = {
     .lightbulb_groups = NULL,
     .ping_inputs = NULL,
     .last_states = NULL,
+    .data_histories = NULL,
     
     .status_led = NULL,
     
@@ -515,17 +520,41 @@ void led_create(const uint16_t gpio, const bool inverted) {
 }
 
 const char http_header1[] = " HTTP/1.1\r\nHost: ";  // 17
-const char http_header2[] = "\r\nUser-Agent: HAA/"HAA_FIRMWARE_VERSION"\r\nConnection: close\r\n";  // 18 + strlen(HAA_FIRMWARE_VERSION + 21
+const char http_header2[] = "\r\nUser-Agent: HAA/"HAA_FIRMWARE_VERSION"\r\n";  // 20 + strlen(HAA_FIRMWARE_VERSION)
+const char http_header_close[] = "Connection: close\r\n";  // 19
 const char http_header_len[] = "Content-length: ";
 
-int new_net_con(char* host, uint16_t port_n, bool is_udp, uint8_t* payload, unsigned int payload_len, int* s, uint8_t rcvtimeout_s, int rcvtimeout_us) {
-    struct addrinfo* res = NULL;
+// --- DNS CACHE
+// Resolved addresses are kept by host and port, and forgotten after a failed connection.
+// Caller must hold network_busy_mutex
+int net_dns_resolve(char* host, uint16_t port_n, bool is_udp, struct sockaddr_storage* addr, socklen_t* addr_len) {
+    const TickType_t now = xTaskGetTickCount();
+    net_dns_t* net_dns = &main_config.net_dns[0];
+    
+    for (unsigned int i = 0; i < NETWORK_DNS_CACHE_SIZE; i++) {
+        net_dns_t* entry = &main_config.net_dns[i];
+        if (entry->host && (now - entry->time) >= MS_TO_TICKS(NETWORK_DNS_CACHE_TTL_MS)) {
+            entry->host = NULL;
+        }
+        
+        if (entry->host && entry->port_n == port_n && strcmp(entry->host, host) == 0) {
+            memcpy(addr, &entry->addr, entry->addr_len);
+            *addr_len = entry->addr_len;
+            return 0;
+        }
+        
+        // Free or oldest entry is replaced
+        if (net_dns->host && (!entry->host || (now - entry->time) > (now - net_dns->time))) {
+            net_dns = entry;
+        }
+    }
+    
     struct addrinfo hints;
-    int result;
+    struct addrinfo* res = NULL;
     char port[8];
-    *s = -2;
     itoa(port_n, port, 10);
     
+    memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;
     
     if (!is_udp) {
@@ -534,46 +563,732 @@ int new_net_con(char* host, uint16_t port_n, bool is_udp, uint8_t* payload, unsi
         hints.ai_socktype = SOCK_DGRAM;
     }
     
-    if (getaddrinfo(host, port, &hints, &res) != 0) {
+    if (getaddrinfo(host, port, &hints, &res) != 0 || res->ai_addrlen > sizeof(struct sockaddr_storage)) {
         if (res) {
             free(res);
         }
         return -3;
     }
     
-    *s = socket(res->ai_family, res->ai_socktype, 0);
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *addr_len = res->ai_addrlen;
+    free(res);
+    
+    net_dns->host = host;
+    net_dns->port_n = port_n;
+    net_dns->time = now;
+    net_dns->addr_len = *addr_len;
+    memcpy(&net_dns->addr, addr, *addr_len);
+    
+    return 0;
+}
+
+void net_dns_forget(char* host, uint16_t port_n) {
+    for (unsigned int i = 0; i < NETWORK_DNS_CACHE_SIZE; i++) {
+        net_dns_t* entry = &main_config.net_dns[i];
+        if (entry->host && entry->port_n == port_n && strcmp(entry->host, host) == 0) {
+            entry->host = NULL;
+        }
+    }
+}
+
+// Resolves host and creates socket
+int net_con_socket(char* host, uint16_t port_n, bool is_udp, int* s, struct sockaddr_storage* addr, socklen_t* addr_len) {
+    *s = -2;
+    
+    if (net_dns_resolve(host, port_n, is_udp, addr, addr_len) < 0) {
+        return -3;
+    }
+    
+    *s = socket(addr->ss_family, is_udp ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (*s < 0) {
-        free(res);
         return -2;
     }
     
     const struct timeval sndtimeout = { 3, 0 };
     setsockopt(*s, SOL_SOCKET, SO_SNDTIMEO, &sndtimeout, sizeof(sndtimeout));
     
+    return 0;
+}
+
+int net_con_connect(char* host, uint16_t port_n, int* s, uint8_t rcvtimeout_s, int rcvtimeout_us) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    int result = net_con_socket(host, port_n, false, s, &addr, &addr_len);
+    if (result < 0) {
+        return result;
+    }
+    
+    const struct timeval rcvtimeout = { rcvtimeout_s, rcvtimeout_us };
+    setsockopt(*s, SOL_SOCKET, SO_RCVTIMEO, &rcvtimeout, sizeof(rcvtimeout));
+    
+    if (connect(*s, (struct sockaddr*) &addr, addr_len) != 0) {
+        net_dns_forget(host, port_n);
+        result = -1;
+    }
+    
+    return result;
+}
+
+int new_net_con(char* host, uint16_t port_n, bool is_udp, uint8_t* payload, unsigned int payload_len, int* s, uint8_t rcvtimeout_s, int rcvtimeout_us) {
     if (!is_udp) {
-        const struct timeval rcvtimeout = { rcvtimeout_s, rcvtimeout_us };
-        setsockopt(*s, SOL_SOCKET, SO_RCVTIMEO, &rcvtimeout, sizeof(rcvtimeout));
+        const int result = net_con_connect(host, port_n, s, rcvtimeout_s, rcvtimeout_us);
+        if (result < 0) {
+            return result;
+        }
         
-        if (connect(*s, res->ai_addr, res->ai_addrlen) != 0) {
-            free(res);
-            return -1;
+        return write(*s, payload, payload_len);
+    }
+    
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    const int result = net_con_socket(host, port_n, true, s, &addr, &addr_len);
+    if (result < 0) {
+        return result;
+    }
+    
+    return sendto(*s, payload, payload_len, 0, (struct sockaddr*) &addr, addr_len);
+}
+
+// --- HTTP CONNECTIONS POOL
+// Connections of HTTP network actions are kept alive, and requests to same target are pipelined.
+// Responses are only followed to know where they end, and they are read before reusing connection.
+// Caller must hold network_busy_mutex
+void net_con_close(net_con_t* net_con) {
+    if (net_con->pending > 0) {
+        INFO("Net %s:%i no reply %i", net_con->host, net_con->port_n, net_con->pending);
+    }
+    
+    close(net_con->socket);
+    net_con->host = NULL;
+}
+
+void net_con_response_end(net_con_t* net_con) {
+    net_con->pending--;
+    net_con->status = 0;
+    
+    if (net_con->closing) {
+        net_con->reusable = false;
+    } else {
+        net_con->confirmed = true;
+    }
+}
+
+void net_con_parse_line(net_con_t* net_con) {
+    const char* line = net_con->line;
+    
+    if (net_con->status == 0) {
+        if (net_con->line_len == 0) {
+            return;
+        }
+        
+        // Only HTTP/1.1 keeps connection alive by default
+        if (net_con->line_len < 12 || strncmp(line, "HTTP/1.1 ", 9) != 0) {
+            net_con->reusable = false;
+            return;
         }
         
-        result = write(*s, payload, payload_len);
+        net_con->status = strtol(line + 9, NULL, 10);
+        net_con->content_len = -1;
         
-    } else {
-        result = sendto(*s, payload, payload_len, 0, res->ai_addr, res->ai_addrlen);
+    } else if (net_con->line_len == 0) {
+        // End of headers
+        if (net_con->status < 200) {
+            net_con->status = 0;
+        } else if (net_con->status == 204 || net_con->status == 304 || net_con->content_len == 0) {
+            net_con_response_end(net_con);
+        } else if (net_con->content_len < 0) {
+            net_con->reusable = false;
+        } else {
+            net_con->body_left = net_con->content_len;
+        }
+        
+    } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+        net_con->content_len = strtol(line + 15, NULL, 10);
+        
+    } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+        net_con->reusable = false;
+        
+    } else if (strncasecmp(line, "Connection:", 11) == 0) {
+        const char* value = line + 11;
+        while (*value == ' ') {
+            value++;
+        }
+        
+        if (strncasecmp(value, "close", 5) == 0) {
+            net_con->closing = true;
+        }
+    }
+}
+
+void net_con_parse(net_con_t* net_con, const char* data, unsigned int len) {
+    while (len > 0 && net_con->reusable) {
+        if (net_con->pending == 0) {
+            // Nothing was requested
+            net_con->reusable = false;
+            
+        } else if (net_con->body_left > 0) {
+            const unsigned int chunk = net_con->body_left < len ? net_con->body_left : len;
+            net_con->body_left -= chunk;
+            data += chunk;
+            len -= chunk;
+            
+            if (net_con->body_left == 0) {
+                net_con_response_end(net_con);
+            }
+            
+        } else {
+            const char c = *data;
+            data++;
+            len--;
+            
+            if (c == '\n') {
+                net_con->line[net_con->line_len] = 0;
+                net_con_parse_line(net_con);
+                net_con->line_len = 0;
+            } else if (c != '\r' && net_con->line_len < NETWORK_CON_LINE_LEN - 1) {
+                net_con->line[net_con->line_len] = c;
+                net_con->line_len++;
+            }
+        }
     }
+}
+
+// Reads responses already received without waiting, and checks that server has not closed connection.
+// Returns false if connection can not be reused
+bool net_con_poll(net_con_t* net_con) {
+    char buffer[64];
     
-    free(res);
-    return result;
+    while (net_con->reusable) {
+        const int read_byte = recv(net_con->socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (read_byte > 0) {
+            net_con_parse(net_con, buffer, read_byte);
+        } else if (read_byte < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            net_con->reusable = false;
+        }
+    }
+    
+    return net_con->reusable;
+}
+
+// Waits for responses until there are no more than pending_max. If print is true, they are logged
+void net_con_wait(net_con_t* net_con, const unsigned int pending_max, const bool print) {
+    char buffer[64];
+    unsigned int total_recv = 0;
+    
+    while (net_con->reusable && net_con->pending > pending_max) {
+        const int read_byte = recv(net_con->socket, buffer, sizeof(buffer), 0);
+        if (read_byte > 0) {
+            if (print && total_recv < 2048) {
+                INFO_NNL("%.*s", read_byte, buffer);
+            }
+            
+            total_recv += read_byte;
+            net_con_parse(net_con, buffer, read_byte);
+        } else {
+            net_con->reusable = false;
+        }
+    }
+    
+    if (print) {
+        INFO("-> %i", total_recv);
+    }
+}
+
+// Closes connections idle for NETWORK_CON_IDLE_MS, and returns ticks until next one expires, or portMAX_DELAY if there are none
+TickType_t net_con_expire() {
+    const TickType_t now = xTaskGetTickCount();
+    TickType_t next = portMAX_DELAY;
+    
+    for (unsigned int i = 0; i < NETWORK_CON_POOL_SIZE; i++) {
+        net_con_t* net_con = &main_config.net_cons[i];
+        if (net_con->host) {
+            const TickType_t idle = now - net_con->last_used;
+            if (idle >= MS_TO_TICKS(NETWORK_CON_IDLE_MS)) {
+                net_con_poll(net_con);
+                net_con_close(net_con);
+            } else if (MS_TO_TICKS(NETWORK_CON_IDLE_MS) - idle < next) {
+                next = MS_TO_TICKS(NETWORK_CON_IDLE_MS) - idle;
+            }
+        }
+    }
+    
+    return next;
+}
+
+// Idle hook of network action workers
+TickType_t net_con_pool_idle() {
+    if (xSemaphoreTake(main_config.network_busy_mutex, 0) == pdTRUE) {
+        const TickType_t next = net_con_expire();
+        xSemaphoreGive(main_config.network_busy_mutex);
+        return next;
+    }
+    
+    return MS_TO_TICKS(NETWORK_CON_IDLE_MS / 4);
+}
+
+// Returns a connection to target, reusing a kept alive one if possible
+net_con_t* net_con_get(char* host, uint16_t port_n, uint8_t rcvtimeout_s, int rcvtimeout_us, int* result, bool* reused) {
+    net_con_expire();
+    
+    const struct timeval rcvtimeout = { rcvtimeout_s, rcvtimeout_us };
+    net_con_t* net_con = NULL;
+    
+    for (unsigned int i = 0; i < NETWORK_CON_POOL_SIZE; i++) {
+        net_con_t* entry = &main_config.net_cons[i];
+        if (entry->host && entry->port_n == port_n && strcmp(entry->host, host) == 0) {
+            setsockopt(entry->socket, SOL_SOCKET, SO_RCVTIMEO, &rcvtimeout, sizeof(rcvtimeout));
+            
+            // Requests are not pipelined until server has kept connection alive once
+            if (!entry->confirmed) {
+                net_con_wait(entry, 0, false);
+            }
+            
+            if (net_con_poll(entry)) {
+                net_con = entry;
+            } else {
+                net_con_close(entry);
+            }
+            
+            break;
+        }
+    }
+    
+    *reused = (net_con != NULL);
+    
+    if (!net_con) {
+        // Free or least recently used entry is replaced
+        net_con = &main_config.net_cons[0];
+        for (unsigned int i = 1; i < NETWORK_CON_POOL_SIZE && net_con->host; i++) {
+            net_con_t* entry = &main_config.net_cons[i];
+            if (!entry->host || (int32_t) (entry->last_used - net_con->last_used) < 0) {
+                net_con = entry;
+            }
+        }
+        
+        if (net_con->host) {
+            net_con_close(net_con);
+        }
+        
+        int socket;
+        *result = net_con_connect(host, port_n, &socket, rcvtimeout_s, rcvtimeout_us);
+        if (*result < 0) {
+            if (socket >= 0) {
+                close(socket);
+            }
+            
+            return NULL;
+        }
+        
+        // Requests are streamed in several writes, so Nagle would hold their last segment until ACK
+        const int nodelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        
+        memset(net_con, 0, sizeof(net_con_t));
+        net_con->host = host;
+        net_con->port_n = port_n;
+        net_con->socket = socket;
+        net_con->reusable = true;
+    }
+    
+    net_con->last_used = xTaskGetTickCount();
+    
+    return net_con;
+}
+
+// --- NETWORK TEMPLATES
+// URL, header and content of network actions are split once after config load into literal
+// segments and characteristic values, so requests are streamed to socket without building them
+const char* const net_methods[] = { "GET", "PUT", "POST" };
+
+unsigned int net_value_format(homekit_characteristic_t* ch, char* buffer) {
+    buffer[0] = 0;
+    
+    if (ch) {
+        switch (ch->value.format) {
+            case HOMEKIT_FORMAT_BOOL:
+                return snprintf(buffer, NETWORK_ACTION_VALUE_LEN, "%s", ch->value.bool_value ? "true" : "false");
+                
+            case HOMEKIT_FORMAT_UINT8:
+            case HOMEKIT_FORMAT_UINT16:
+            case HOMEKIT_FORMAT_UINT32:
+            case HOMEKIT_FORMAT_UINT64:
+            case HOMEKIT_FORMAT_INT:
+                return snprintf(buffer, NETWORK_ACTION_VALUE_LEN, "%i", ch->value.int_value);
+                
+            case HOMEKIT_FORMAT_FLOAT:
+                return snprintf(buffer, NETWORK_ACTION_VALUE_LEN, "%1.7g", ch->value.float_value);
+                
+            default:
+                break;
+        }
+    }
+    
+    return 0;
+}
+
+// Builds a template from concatenated parts. If segments is NULL, it only counts segments
+unsigned int net_template_split(ch_group_t* ch_group, const char* const* parts, const unsigned int parts_count, net_segment_t* segments) {
+    unsigned int count = 0;
+    
+    for (unsigned int i = 0; i < parts_count; i++) {
+        const char* literal = parts[i];
+        
+        for (;;) {
+            const char* wildcard = strstr(literal, NETWORK_ACTION_WILDCARD_VALUE);
+            if (wildcard && strnlen(wildcard, NETWORK_ACTION_WILDCARD_LEN) < NETWORK_ACTION_WILDCARD_LEN) {
+                wildcard = NULL;
+            }
+            
+            const unsigned int literal_len = wildcard ? wildcard - literal : strlen(literal);
+            if (literal_len > 0) {
+                if (segments) {
+                    segments[count].len = literal_len;
+                    segments[count].literal = literal;
+                }
+                count++;
+            }
+            
+            if (!wildcard) {
+                break;
+            }
+            
+            if (segments) {
+                char buffer[3];
+                buffer[2] = 0;
+                
+                buffer[0] = wildcard[5];
+                buffer[1] = wildcard[6];
+                const int acc_number = strtol(buffer, NULL, 10);
+                
+                buffer[0] = wildcard[7];
+                buffer[1] = wildcard[8];
+                const unsigned int ch_number = strtol(buffer, NULL, 10);
+                
+                ch_group_t* ch_group_found = ch_group;
+                if (acc_number > 0) {
+                    ch_group_found = ch_group_find_by_serv(acc_number);
+                }
+                
+                segments[count].len = 0;
+                segments[count].ch = NULL;
+                if (ch_group_found && ch_number < ch_group_found->chs) {
+                    segments[count].ch = ch_group_found->ch[ch_number];
+                } else {
+                    ERROR("<%i> Wildcard %.*s", ch_group->serv_index, NETWORK_ACTION_WILDCARD_LEN, wildcard);
+                }
+            }
+            count++;
+            
+            literal = wildcard + NETWORK_ACTION_WILDCARD_LEN;
+        }
+    }
+    
+    return count;
+}
+
+net_template_t* net_template_new(ch_group_t* ch_group, const char* const* parts, const unsigned int parts_count) {
+    const unsigned int count = net_template_split(ch_group, parts, parts_count, NULL);
+    
+    net_template_t* net_template = malloc(sizeof(net_template_t) + (count * sizeof(net_segment_t)));
+    if (net_template) {
+        net_template->count = count;
+        net_template_split(ch_group, parts, parts_count, net_template->segments);
+        
+        net_template->values = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            if (net_template->segments[i].len == 0) {
+                net_template->values++;
+            }
+        }
+    }
+    
+    return net_template;
+}
+
+void net_template_build(ch_group_t* ch_group, action_network_t* action_network) {
+    if (action_network->method_n < 3) {
+        const char* const head_parts[] = {
+            net_methods[action_network->method_n],
+            " /",
+            action_network->url,
+            http_header1,
+            action_network->host,
+            http_header2,
+            action_network->header
+        };
+        
+        action_network->head = net_template_new(ch_group, head_parts, sizeof(head_parts) / sizeof(head_parts[0]));
+    }
+    
+    if ((action_network->method_n > 0 && action_network->method_n < 4) ||
+        action_network->method_n == 13) {
+        const char* const body_parts[] = { action_network->content };
+        action_network->body = net_template_new(ch_group, body_parts, 1);
+        
+        if (action_network->body && action_network->body->values > 0) {
+            action_network->body_values = malloc(action_network->body->values * NETWORK_ACTION_VALUE_LEN);
+            if (!action_network->body_values) {
+                free(action_network->body);
+                action_network->body = NULL;
+            }
+        }
+    }
+}
+
+// Formats template values into values buffer, and returns length of rendered template
+unsigned int net_template_format(net_template_t* net_template, char* values) {
+    unsigned int len = 0;
+    
+    for (unsigned int i = 0; i < net_template->count; i++) {
+        net_segment_t* segment = &net_template->segments[i];
+        if (segment->len > 0) {
+            len += segment->len;
+        } else {
+            len += net_value_format(segment->ch, values);
+            INFO("Wildcard val: %s", values);
+            values += NETWORK_ACTION_VALUE_LEN;
+        }
+    }
+    
+    return len;
+}
+
+void net_stream_flush(net_stream_t* stream) {
+    if (stream->len > 0 && stream->socket >= 0 && stream->result >= 0) {
+        INFO_NNL("%.*s", stream->len, stream->buffer);
+        
+        const int written = write(stream->socket, stream->buffer, stream->len);
+        if (written == stream->len) {
+            stream->result += written;
+        } else {
+            stream->result = written < 0 ? written : -1;
+        }
+        
+        stream->len = 0;
+    }
+}
+
+void net_stream_write(net_stream_t* stream, const char* data, unsigned int len) {
+    while (len > 0) {
+        if (stream->len == stream->size) {
+            if (stream->socket < 0) {
+                return;
+            }
+            
+            net_stream_flush(stream);
+        }
+        
+        unsigned int chunk = stream->size - stream->len;
+        if (chunk > len) {
+            chunk = len;
+        }
+        
+        memcpy(stream->buffer + stream->len, data, chunk);
+        stream->len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+// Writes template to stream. If values is NULL, they are formatted now
+void net_template_write(net_stream_t* stream, net_template_t* net_template, char* values) {
+    for (unsigned int i = 0; i < net_template->count; i++) {
+        net_segment_t* segment = &net_template->segments[i];
+        if (segment->len > 0) {
+            net_stream_write(stream, segment->literal, segment->len);
+        } else if (values) {
+            net_stream_write(stream, values, strlen(values));
+            values += NETWORK_ACTION_VALUE_LEN;
+        } else {
+            char buffer[NETWORK_ACTION_VALUE_LEN];
+            net_stream_write(stream, buffer, net_value_format(segment->ch, buffer));
+        }
+    }
 }
 
 void hkc_autooff_setter_task(TimerHandle_t xTimer);
 void do_actions(ch_group_t* ch_group, uint8_t action);
 void do_wildcard_actions(ch_group_t* ch_group, uint8_t index, const float action_value);
 
+// --- POLLING SCHEDULER
+#ifdef ESP_PLATFORM
+static portMUX_TYPE poll_scheduler_spinlock = portMUX_INITIALIZER_UNLOCKED;
+#define POLL_SCHEDULER_ENTER_CRITICAL()     taskENTER_CRITICAL(&poll_scheduler_spinlock)
+#define POLL_SCHEDULER_EXIT_CRITICAL()      taskEXIT_CRITICAL(&poll_scheduler_spinlock)
+#else
+#define POLL_SCHEDULER_ENTER_CRITICAL()     taskENTER_CRITICAL()
+#define POLL_SCHEDULER_EXIT_CRITICAL()      taskEXIT_CRITICAL()
+#endif
+
+// Phase, in slots, whose slots have the lowest load for given period. Chosen slots are marked as used.
+// Slots are approximated when period is not a divisor of cycle.
+unsigned int poll_scheduler_phase(const uint32_t period_ms) {
+    uint8_t* slots = main_config.poll_scheduler.slots;
+    const unsigned int period_slots = period_ms / POLL_SCHEDULER_SLOT_MS;
+    
+    if (period_slots == 0) {
+        // Faster than a slot, it fires in all of them
+        for (unsigned int i = 0; i < POLL_SCHEDULER_SLOTS; i++) {
+            if (slots[i] < UINT8_MAX) {
+                slots[i]++;
+            }
+        }
+        
+        return 0;
+    }
+    
+    const unsigned int phases = period_slots < POLL_SCHEDULER_SLOTS ? period_slots : POLL_SCHEDULER_SLOTS;
+    unsigned int best_phase = 0;
+    unsigned int best_max = UINT_MAX;
+    unsigned int best_sum = UINT_MAX;
+    
+    for (unsigned int phase = 0; phase < phases; phase++) {
+        unsigned int max = 0;
+        unsigned int sum = 0;
+        for (unsigned int slot = phase; slot < POLL_SCHEDULER_SLOTS; slot += period_slots) {
+            sum += slots[slot];
+            if (slots[slot] > max) {
+                max = slots[slot];
+            }
+        }
+        
+        if (max < best_max || (max == best_max && sum < best_sum)) {
+            best_phase = phase;
+            best_max = max;
+            best_sum = sum;
+        }
+    }
+    
+    for (unsigned int slot = best_phase; slot < POLL_SCHEDULER_SLOTS; slot += period_slots) {
+        if (slots[slot] < UINT8_MAX) {
+            slots[slot]++;
+        }
+    }
+    
+    return best_phase;
+}
+
+rs_wheel_timer_t* poll_timer_create(const uint32_t period_ms, void* args, rs_timer_callback_t callback) {
+    rs_wheel_timer_t* timer = rs_wheel_timer_create(period_ms, true, args, callback);
+    if (timer) {
+        main_config.poll_scheduler.timers++;
+        
+        poll_retry_t* poll_retry = malloc(sizeof(poll_retry_t));
+        if (poll_retry) {
+            poll_retry->callback = callback;
+            poll_retry->args = args;
+            poll_retry->pending = false;
+            poll_retry->next = main_config.poll_scheduler.retries;
+            main_config.poll_scheduler.retries = poll_retry;
+        }
+    }
+    
+    return timer;
+}
+
+// Starts poller at its phase of cycle, counted from scheduler epoch
+void poll_timer_start(rs_wheel_timer_t* timer) {
+    if (!timer) {
+        return;
+    }
+    
+    const uint32_t period_ms = timer->period * POLL_TIMER_RESOLUTION_MS;
+    uint32_t phase_ms = poll_scheduler_phase(period_ms) * POLL_SCHEDULER_SLOT_MS;
+#if POLL_SCHEDULER_JITTER_MS > 0
+    phase_ms += hwrand() % POLL_SCHEDULER_JITTER_MS;
+#endif
+    
+    const uint32_t elapsed_ms = (xTaskGetTickCount() - main_config.poll_scheduler.epoch) * portTICK_PERIOD_MS;
+    const uint32_t delay_ms = (phase_ms % period_ms + period_ms - elapsed_ms % period_ms) % period_ms;
+    
+    rs_wheel_timer_start_in(timer, delay_ms);
+}
+
+void poll_task_retry(void* args) {
+    poll_retry_t* poll_retry = (poll_retry_t*) args;
+    poll_retry->pending = false;
+    poll_retry->callback(poll_retry->args);
+}
+
+// Sensor task admission. When POLL_TASKS_MAX tasks are running, callback is called again after POLL_SCHEDULER_RETRY_MS.
+// Only one retry by poller is armed; polls while it is pending are merged into it.
+bool poll_task_take(rs_timer_callback_t callback, void* args) {
+    POLL_SCHEDULER_ENTER_CRITICAL();
+    const bool taken = (main_config.poll_scheduler.tasks < POLL_TASKS_MAX);
+    if (taken) {
+        main_config.poll_scheduler.tasks++;
+        if (main_config.poll_scheduler.tasks > main_config.poll_scheduler.tasks_peak) {
+            main_config.poll_scheduler.tasks_peak = main_config.poll_scheduler.tasks;
+        }
+    }
+    POLL_SCHEDULER_EXIT_CRITICAL();
+    
+    if (!taken) {
+        poll_retry_t* poll_retry = main_config.poll_scheduler.retries;
+        while (poll_retry && (poll_retry->callback != callback || poll_retry->args != args)) {
+            poll_retry = poll_retry->next;
+        }
+        
+        if (poll_retry) {
+            if (poll_retry->pending) {
+                return false;
+            }
+            
+            poll_retry->pending = true;
+            if (rs_timer_pool_arm(POLL_SCHEDULER_RETRY_MS, poll_task_retry, poll_retry) != 0) {
+                main_config.poll_scheduler.deferred++;
+                return false;
+            }
+            
+            poll_retry->pending = false;
+        }
+        
+        main_config.poll_scheduler.skipped++;
+        ERROR("Poll skip");
+    }
+    
+    return taken;
+}
+
+// Sensor tasks not started by pollers are counted, but never deferred
+void poll_task_add() {
+    POLL_SCHEDULER_ENTER_CRITICAL();
+    main_config.poll_scheduler.tasks++;
+    POLL_SCHEDULER_EXIT_CRITICAL();
+}
+
+void poll_task_give() {
+    POLL_SCHEDULER_ENTER_CRITICAL();
+    if (main_config.poll_scheduler.tasks > 0) {
+        main_config.poll_scheduler.tasks--;
+    }
+    POLL_SCHEDULER_EXIT_CRITICAL();
+}
+
+void poll_scheduler_stats() {
+    unsigned int used = 0;
+    unsigned int max = 0;
+    for (unsigned int i = 0; i < POLL_SCHEDULER_SLOTS; i++) {
+        if (main_config.poll_scheduler.slots[i] > 0) {
+            used++;
+            if (main_config.poll_scheduler.slots[i] > max) {
+                max = main_config.poll_scheduler.slots[i];
+            }
+        }
+    }
+    
+    INFO("Poll %i timers, slots %i/%i max %i, tasks %i peak %i, deferred %"HAA_LONGINT_F", skipped %"HAA_LONGINT_F,
+         main_config.poll_scheduler.timers, used, POLL_SCHEDULER_SLOTS, max,
+         main_config.poll_scheduler.tasks, main_config.poll_scheduler.tasks_peak,
+         main_config.poll_scheduler.deferred, main_config.poll_scheduler.skipped);
+}
+
 #ifdef HAA_DEBUG
+void action_workers_stats();
+
 uint_fast32_t free_heap = 0;
 void free_heap_watchdog() {
     uint_fast32_t size = xPortGetFreeHeapSize();
@@ -593,6 +1308,8 @@ void free_heap_watchdog() {
         INFO("* CPU Speed = %"HAA_LONGINT_F, sdk_system_get_cpu_freq());
 #endif
         stats_display();
+        action_workers_stats();
+        poll_scheduler_stats();
     }
 }
 #endif  // HAA_DEBUG
@@ -627,7 +1344,22 @@ uint16_t get_absolut_index(const uint16_t base, const int16_t rel_index) {
     return rel_index;
 }
 
-int process_hexstr(const char* string, uint8_t** output_hex_string, unistring_t** unistrings) {
+unsigned int json_count_strings(cJSON_rsf* json) {
+    unsigned int count = 0;
+    
+    cJSON_rsf* json_item;
+    cJSON_rsf_ArrayForEach(json_item, json) {
+        if (cJSON_rsf_IsString(json_item)) {
+            count++;
+        } else if (json_item->child) {
+            count += json_count_strings(json_item);
+        }
+    }
+    
+    return count;
+}
+
+int process_hexstr(const char* string, uint8_t** output_hex_string, unistrings_t* unistrings) {
     const unsigned int len = strlen(string) >> 1;
     uint8_t* hex_string = malloc(len);
     //memset(hex_string, 0, len);
@@ -683,6 +1415,14 @@ ch_group_t* new_ch_group(const uint8_t chs, const uint8_t nums_i, const uint8_t
 }
 
 ch_group_t* ch_group_find(homekit_characteristic_t* ch) {
+    if (ch->context) {
+        return ch->context;
+    }
+    
+    if (main_config.ch_groups_by_serv) {
+        return NULL;
+    }
+    
     ch_group_t* ch_group = main_config.ch_groups;
     while (ch_group) {
         for (unsigned int i = 0; i < ch_group->chs; i++) {
@@ -693,31 +1433,262 @@ ch_group_t* ch_group_find(homekit_characteristic_t* ch) {
                 return ch_group;
             }
         }
-        
-        ch_group = ch_group->next;
+        
+        ch_group = ch_group->next;
+    }
+
+    return NULL;
+}
+
+ch_group_t* ch_group_find_by_serv(const uint16_t service) {
+    if (main_config.ch_groups_by_serv) {
+        if (service < main_config.ch_groups_by_serv_size) {
+            return main_config.ch_groups_by_serv[service];
+        }
+        
+        return NULL;
+    }
+    
+    ch_group_t* ch_group = main_config.ch_groups;
+    while (ch_group &&
+           ch_group->serv_index != service) {
+        ch_group = ch_group->next;
+    }
+
+    return ch_group;
+}
+
+lightbulb_group_t* lightbulb_group_find(homekit_characteristic_t* ch) {
+    if (main_config.lightbulb_groups_by_ch) {
+        int low = 0;
+        int high = main_config.lightbulb_groups_by_ch_size - 1;
+        while (low <= high) {
+            const int middle = (low + high) >> 1;
+            lightbulb_group_t* lightbulb_group = main_config.lightbulb_groups_by_ch[middle];
+            
+            if (lightbulb_group->ch0 == ch) {
+                return lightbulb_group;
+            }
+            
+            if ((uintptr_t) lightbulb_group->ch0 < (uintptr_t) ch) {
+                low = middle + 1;
+            } else {
+                high = middle - 1;
+            }
+        }
+        
+        return NULL;
+    }
+    
+    lightbulb_group_t* lightbulb_group = main_config.lightbulb_groups;
+    while (lightbulb_group &&
+           lightbulb_group->ch0 != ch) {
+        lightbulb_group = lightbulb_group->next;
+    }
+
+    return lightbulb_group;
+}
+
+static int lightbulb_group_compare(const void* a, const void* b) {
+    const uintptr_t ch_a = (uintptr_t) (*(lightbulb_group_t**) a)->ch0;
+    const uintptr_t ch_b = (uintptr_t) (*(lightbulb_group_t**) b)->ch0;
+    
+    return (ch_a > ch_b) - (ch_a < ch_b);
+}
+
+// Reverse indexes for lookups from setters and notifications. Same results as list walks: first match in list order
+void ch_group_index_build() {
+    unsigned int max_serv_index = 0;
+    ch_group_t* ch_group = main_config.ch_groups;
+    while (ch_group) {
+        if (ch_group->serv_index > max_serv_index) {
+            max_serv_index = ch_group->serv_index;
+        }
+        
+        if (ch_group->serv_type != SERV_TYPE_DATA_HISTORY) {
+            const unsigned int chs = (ch_group->serv_type == SERV_TYPE_FREE_MONITOR && ch_group->chs > 0) ? 1 : ch_group->chs;
+            for (unsigned int i = 0; i < chs; i++) {
+                if (ch_group->ch[i] && !ch_group->ch[i]->context) {
+                    ch_group->ch[i]->context = ch_group;
+                }
+            }
+        }
+        
+        ch_group = ch_group->next;
+    }
+    
+    main_config.ch_groups_by_serv = calloc(max_serv_index + 1, sizeof(ch_group_t*));
+    if (main_config.ch_groups_by_serv) {
+        main_config.ch_groups_by_serv_size = max_serv_index + 1;
+        
+        ch_group = main_config.ch_groups;
+        while (ch_group) {
+            if (!main_config.ch_groups_by_serv[ch_group->serv_index]) {
+                main_config.ch_groups_by_serv[ch_group->serv_index] = ch_group;
+            }
+            
+            ch_group = ch_group->next;
+        }
+    }
+    
+    unsigned int lightbulb_count = 0;
+    lightbulb_group_t* lightbulb_group = main_config.lightbulb_groups;
+    while (lightbulb_group) {
+        lightbulb_count++;
+        lightbulb_group = lightbulb_group->next;
+    }
+    
+    if (lightbulb_count > 0) {
+        main_config.lightbulb_groups_by_ch = malloc(lightbulb_count * sizeof(lightbulb_group_t*));
+        if (main_config.lightbulb_groups_by_ch) {
+            main_config.lightbulb_groups_by_ch_size = lightbulb_count;
+            
+            lightbulb_group = main_config.lightbulb_groups;
+            for (unsigned int i = 0; i < lightbulb_count; i++) {
+                main_config.lightbulb_groups_by_ch[i] = lightbulb_group;
+                lightbulb_group = lightbulb_group->next;
+            }
+            
+            qsort(main_config.lightbulb_groups_by_ch, lightbulb_count, sizeof(lightbulb_group_t*), lightbulb_group_compare);
+        }
+    }
+}
+
+// Action lists by ACTION_TYPE_*. All action nodes begin with uint8_t action
+static const struct {
+    uint8_t head;
+    uint8_t next;
+} action_lists[ACTION_TYPES] = {
+    { offsetof(ch_group_t, action_copy),            offsetof(action_copy_t, next) },
+    { offsetof(ch_group_t, action_binary_output),   offsetof(action_binary_output_t, next) },
+    { offsetof(ch_group_t, action_serv_manager),    offsetof(action_serv_manager_t, next) },
+    { offsetof(ch_group_t, action_system),          offsetof(action_system_t, next) },
+    { offsetof(ch_group_t, action_network),         offsetof(action_network_t, next) },
+    { offsetof(ch_group_t, action_irrf_tx),         offsetof(action_irrf_tx_t, next) },
+    { offsetof(ch_group_t, action_uart),            offsetof(action_uart_t, next) },
+    { offsetof(ch_group_t, action_pwm),             offsetof(action_pwm_t, next) },
+    { offsetof(ch_group_t, action_set_ch),          offsetof(action_set_ch_t, next) },
+};
+
+#define ACTION_LIST_HEAD(ch_group, type)    (*(void**) (((uint8_t*) (ch_group)) + action_lists[type].head))
+#define ACTION_LIST_NEXT(node, type)        (*(void**) (((uint8_t*) (node)) + action_lists[type].next))
+#define ACTION_NODE_ACTION(node)            (*(uint8_t*) (node))
+
+// Entry of action in action table, NULL if there is no table or action has no nodes
+action_entry_t* action_entry_find(ch_group_t* ch_group, const uint8_t action) {
+    action_table_t* action_table = ch_group->action_table;
+    if (action_table) {
+        int low = 0;
+        int high = action_table->count - 1;
+        while (low <= high) {
+            const int middle = (low + high) >> 1;
+            action_entry_t* action_entry = &action_table->entries[middle];
+            
+            if (action_entry->action == action) {
+                return action_entry;
+            }
+            
+            if (action_entry->action < action) {
+                low = middle + 1;
+            } else {
+                high = middle - 1;
+            }
+        }
     }
-
+    
     return NULL;
 }
 
-ch_group_t* ch_group_find_by_serv(const uint16_t service) {
-    ch_group_t* ch_group = main_config.ch_groups;
-    while (ch_group &&
-           ch_group->serv_index != service) {
-        ch_group = ch_group->next;
+// First node of action_entry in list of type. Without action table, it is list head and caller must check every node
+void* action_entry_first(ch_group_t* ch_group, action_entry_t* action_entry, const unsigned int type) {
+    if (!ch_group->action_table) {
+        return ACTION_LIST_HEAD(ch_group, type);
+    }
+    
+    const unsigned int type_bit = 1 << type;
+    if (action_entry && (action_entry->types & type_bit)) {
+        return ch_group->action_table->first[action_entry->first + __builtin_popcount(action_entry->types & (type_bit - 1))];
     }
+    
+    return NULL;
+}
 
-    return ch_group;
+void* action_first(ch_group_t* ch_group, const uint8_t action, const unsigned int type) {
+    return action_entry_first(ch_group, action_entry_find(ch_group, action), type);
 }
 
-lightbulb_group_t* lightbulb_group_find(homekit_characteristic_t* ch) {
-    lightbulb_group_t* lightbulb_group = main_config.lightbulb_groups;
-    while (lightbulb_group &&
-           lightbulb_group->ch0 != ch) {
-        lightbulb_group = lightbulb_group->next;
+// Per action table of first nodes. Lists are built by action, so all nodes of an action are consecutive
+void action_table_build(ch_group_t* ch_group) {
+    uint32_t actions[8] = { 0 };
+    unsigned int action_count = 0;
+    unsigned int run_count = 0;
+    
+    for (unsigned int type = 0; type < ACTION_TYPES; type++) {
+        uint32_t type_actions[8] = { 0 };
+        int last_action = -1;
+        
+        void* node = ACTION_LIST_HEAD(ch_group, type);
+        while (node) {
+            const uint8_t action = ACTION_NODE_ACTION(node);
+            if (action != last_action) {
+                if (type_actions[action >> 5] & (1UL << (action & 31))) {
+                    return;     // Not consecutive, list walk is kept
+                }
+                
+                type_actions[action >> 5] |= 1UL << (action & 31);
+                last_action = action;
+                run_count++;
+                
+                if (!(actions[action >> 5] & (1UL << (action & 31)))) {
+                    actions[action >> 5] |= 1UL << (action & 31);
+                    action_count++;
+                }
+            }
+            
+            node = ACTION_LIST_NEXT(node, type);
+        }
     }
-
-    return lightbulb_group;
+    
+    if (action_count == 0 || action_count > UINT8_MAX) {
+        return;
+    }
+    
+    action_table_t* action_table = malloc(sizeof(action_table_t) + (run_count * sizeof(void*)) + (action_count * sizeof(action_entry_t)));
+    if (!action_table) {
+        return;
+    }
+    
+    action_table->count = action_count;
+    action_table->first = (void**) (action_table + 1);
+    action_table->entries = (action_entry_t*) (action_table->first + run_count);
+    
+    unsigned int entry_index = 0;
+    unsigned int first_index = 0;
+    for (unsigned int action = 0; action < 256; action++) {
+        if (actions[action >> 5] & (1UL << (action & 31))) {
+            action_entry_t* action_entry = &action_table->entries[entry_index];
+            action_entry->action = action;
+            action_entry->types = 0;
+            action_entry->first = first_index;
+            
+            for (unsigned int type = 0; type < ACTION_TYPES; type++) {
+                void* node = ACTION_LIST_HEAD(ch_group, type);
+                while (node && ACTION_NODE_ACTION(node) != action) {
+                    node = ACTION_LIST_NEXT(node, type);
+                }
+                
+                if (node) {
+                    action_entry->types |= 1 << type;
+                    action_table->first[first_index] = node;
+                    first_index++;
+                }
+            }
+            
+            entry_index++;
+        }
+    }
+    
+    ch_group->action_table = action_table;
 }
 
 #if !defined(CONFIG_IDF_TARGET_ESP32C2) \
@@ -815,6 +1786,59 @@ float get_hkch_value(homekit_characteristic_t* ch) {
     return 0;
 }
 
+void data_history_add_register(ch_group_t* ch_group, data_history_t* data_history, const uint32_t final_time, const int32_t final_data) {
+    if (data_history && data_history->compressed) {
+        hist_block_encoder_t* encoder = &data_history->encoder;
+        
+        if (!encoder->block || !hist_block_add(encoder, final_time, final_data)) {
+            if (encoder->block) {
+                data_history->block = (data_history->block + 1) % ch_group->chs;
+            }
+            
+            hist_block_start(encoder, ch_group->ch[data_history->block]->value.data_value, HIST_COMPRESSED_BLOCK_SIZE, final_time, final_data);
+        }
+        
+        ch_group->ch[data_history->block]->value.data_size = hist_block_size(encoder);
+        
+        return;
+    }
+    
+    uint32_t last_register = HIST_LAST_REGISTER;
+    last_register += HIST_REGISTER_SIZE;
+    uint32_t current_ch = last_register / HIST_BLOCK_SIZE;
+    uint32_t current_pos = last_register % HIST_BLOCK_SIZE;
+    
+    if (current_ch >= ch_group->chs) {
+        current_ch = 0;
+        current_pos = 0;
+    }
+    
+    //INFO("Current ch & pos: %i, %i", current_ch, current_pos);
+    
+    if (ch_group->ch[current_ch]->value.data_size < HIST_BLOCK_SIZE) {
+        ch_group->ch[current_ch]->value.data_size = HIST_BLOCK_SIZE;
+    }
+    
+    memcpy(ch_group->ch[current_ch]->value.data_value + current_pos, &final_time, HIST_TIME_SIZE);
+    memcpy(ch_group->ch[current_ch]->value.data_value + current_pos + HIST_TIME_SIZE, &final_data, HIST_DATA_SIZE);
+    
+    HIST_LAST_REGISTER = (current_ch * HIST_BLOCK_SIZE) + current_pos;
+}
+
+void data_history_flash_read_callback(void* args, const uint32_t time, const int32_t value) {
+    data_history_t* data_history = args;
+    data_history_add_register(data_history->ch_group, data_history, time, value);
+}
+
+data_history_t* data_history_find(ch_group_t* ch_group) {
+    data_history_t* data_history = main_config.data_histories;
+    while (data_history && data_history->ch_group != ch_group) {
+        data_history = data_history->next;
+    }
+    
+    return data_history;
+}
+
 void save_data_history(homekit_characteristic_t* ch_target) {
     if (!main_config.clock_ready) {
         return;
@@ -838,34 +1862,21 @@ void save_data_history(homekit_characteristic_t* ch_target) {
             
             //INFO("Saved %i, %i (%0.5f)", final_time, final_data, value);
             
-            uint32_t last_register = HIST_LAST_REGISTER;
-            last_register += HIST_REGISTER_SIZE;
-            uint32_t current_ch = last_register / HIST_BLOCK_SIZE;
-            uint32_t current_pos = last_register % HIST_BLOCK_SIZE;
-            
-            if (current_ch >= ch_group->chs) {
-                current_ch = 0;
-                current_pos = 0;
-            }
+            data_history_t* data_history = data_history_find(ch_group);
             
-            //INFO("Current ch & pos: %i, %i", current_ch, current_pos);
+            data_history_add_register(ch_group, data_history, final_time, final_data);
             
-            if (ch_group->ch[current_ch]->value.data_size < HIST_BLOCK_SIZE) {
-                ch_group->ch[current_ch]->value.data_size = HIST_BLOCK_SIZE;
+            if (data_history && data_history->hist_flash) {
+                hist_flash_add(data_history->hist_flash, final_time, final_data);
             }
-            
-            memcpy(ch_group->ch[current_ch]->value.data_value + current_pos, &final_time, HIST_TIME_SIZE);
-            memcpy(ch_group->ch[current_ch]->value.data_value + current_pos + HIST_TIME_SIZE, &final_data, HIST_DATA_SIZE);
-            
-            HIST_LAST_REGISTER = (current_ch * HIST_BLOCK_SIZE) + current_pos;
         }
         
         ch_group = ch_group->next;
     }
 }
 
-void data_history_timer_worker(TimerHandle_t xTimer) {
-    ch_group_t* ch_group = (ch_group_t*) pvTimerGetTimerID(xTimer);
+void data_history_timer_worker(void* args) {
+    ch_group_t* ch_group = (ch_group_t*) args;
     save_data_history(ch_group_find_by_serv(HIST_SERVICE)->ch[HIST_CH]);
 }
 
@@ -930,6 +1941,15 @@ void reboot_task() {
     INFO("\nRebooting\n");
     rs_esp_timer_stop_forced(WIFI_WATCHDOG_TIMER);
     
+    // Keep Data History samples still buffered in RAM
+    data_history_t* data_history = main_config.data_histories;
+    while (data_history) {
+        if (data_history->hist_flash) {
+            hist_flash_flush(data_history->hist_flash);
+        }
+        data_history = data_history->next;
+    }
+    
     random_task_short_delay();
     
     sdk_system_restart();
@@ -1283,67 +2303,510 @@ void ping_task() {
                 INFO("Ping %s OK", ping_input->host);
                 ping_input_run_callback_fn(ping_input->callback_1);
                 
-            } else if ((ping_result == 0) && (ping_input->last_response || ping_input->ignore_last_response)) {
-                ping_input->last_response = false;
-                INFO("Ping %s FAIL", ping_input->host);
-                ping_input_run_callback_fn(ping_input->callback_0);
-            }
-            
-            ping_input = ping_input->next;
+            } else if ((ping_result == 0) && (ping_input->last_response || ping_input->ignore_last_response)) {
+                ping_input->last_response = false;
+                INFO("Ping %s FAIL", ping_input->host);
+                ping_input_run_callback_fn(ping_input->callback_0);
+            }
+            
+            ping_input = ping_input->next;
+        }
+        
+        xSemaphoreGive(main_config.network_busy_mutex);
+    }
+    
+    poll_task_give();
+    
+    vTaskDelete(NULL);
+}
+
+void ping_task_timer_worker(void* args) {
+    if (!homekit_is_pairing()) {
+        if (!poll_task_take(ping_task_timer_worker, args)) {
+            return;
+        }
+        
+        if (xTaskCreate(ping_task, "PIN", PING_TASK_SIZE, NULL, PING_TASK_PRIORITY, NULL) != pdPASS) {
+            poll_task_give();
+            homekit_remove_oldest_client();
+            ERROR("PIN");
+        }
+    } else {
+        ERROR("PING pair %i", homekit_is_pairing());
+    }
+}
+
+// -----
+
+void setup_mode_call(const uint16_t gpio, void* args, const uint8_t param) {
+    INFO("Setup");
+    
+    if (main_config.setup_mode_time == 0 || xTaskGetTickCount() < main_config.setup_mode_time * (1000 / portTICK_PERIOD_MS)) {
+        sysparam_set_int8(HAA_SETUP_MODE_SYSPARAM, 1);
+        reboot_haa();
+    } else {
+        ERROR("Not after %is", main_config.setup_mode_time);
+    }
+}
+
+void setup_mode_toggle_upcount(ch_group_t* ch_group) {
+    if (ch_group->homekit_enabled && main_config.setup_mode_toggle_counter_max > 0) {
+        main_config.setup_mode_toggle_counter++;
+        INFO("Setup %i/%i", main_config.setup_mode_toggle_counter, main_config.setup_mode_toggle_counter_max);
+        
+        if (main_config.setup_mode_toggle_counter == main_config.setup_mode_toggle_counter_max) {
+            setup_mode_call(99, NULL, 0);
+        } else {
+            rs_esp_timer_start(main_config.setup_mode_toggle_timer);
+        }
+    }
+}
+
+void setup_mode_toggle() {
+    main_config.setup_mode_toggle_counter = 0;
+}
+
+// -----
+#if defined(LAST_STATES_SNAPSHOT) || defined(CONFIG_CACHE)
+static uint32_t haa_crc32(const uint8_t* data, const size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (unsigned int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    
+    return ~crc;
+}
+#endif
+
+#ifdef LAST_STATES_SNAPSHOT
+// Last states snapshot: all saved states packed in one versioned blob, protected
+// by CRC32 and written alternately to two sysparam keys, so an interrupted write
+// always leaves the previous snapshot readable.
+//
+// Header:  version (1), reserved (1), count (2), sequence (4)
+// Entry:   ch_state_id (2), ch_type (1), len (2), value (len)
+// Trailer: CRC32 of all previous bytes (4)
+//
+// Version 1 snapshots, with a 1 byte len, are still read.
+
+static bool last_states_snapshot_is_valid(const uint8_t* snapshot, const size_t len) {
+    if (len < LAST_STATES_SNAPSHOT_HEADER_SIZE + LAST_STATES_SNAPSHOT_CRC_SIZE
+        || (snapshot[0] != LAST_STATES_SNAPSHOT_VERSION && snapshot[0] != LAST_STATES_SNAPSHOT_VERSION_1)) {
+        return false;
+    }
+    
+    uint32_t crc;
+    memcpy(&crc, snapshot + len - LAST_STATES_SNAPSHOT_CRC_SIZE, sizeof(crc));
+    
+    return crc == haa_crc32(snapshot, len - LAST_STATES_SNAPSHOT_CRC_SIZE);
+}
+
+void last_states_snapshot_load() {
+    const char* const keys[2] = { LAST_STATES_SNAPSHOT_SYSPARAM_A, LAST_STATES_SNAPSHOT_SYSPARAM_B };
+    
+    for (unsigned int i = 0; i < 2; i++) {
+        uint8_t* snapshot = NULL;
+        size_t len = 0;
+        
+        if (sysparam_get_blob(keys[i], &snapshot, &len) == SYSPARAM_OK && last_states_snapshot_is_valid(snapshot, len)) {
+            uint32_t seq;
+            memcpy(&seq, snapshot + 4, sizeof(seq));
+            
+            if (!main_config.last_states_snapshot || (int32_t) (seq - main_config.last_states_snapshot_seq) > 0) {
+                free(main_config.last_states_snapshot);
+                main_config.last_states_snapshot = snapshot;
+                main_config.last_states_snapshot_len = len - LAST_STATES_SNAPSHOT_CRC_SIZE;
+                main_config.last_states_snapshot_seq = seq;
+                snapshot = NULL;
+            }
+        }
+        
+        free(snapshot);
+    }
+    
+    if (main_config.last_states_snapshot) {
+        main_config.last_states_snapshot_crc = haa_crc32(main_config.last_states_snapshot + LAST_STATES_SNAPSHOT_HEADER_SIZE, main_config.last_states_snapshot_len - LAST_STATES_SNAPSHOT_HEADER_SIZE);
+        INFO("Snapshot %i", main_config.last_states_snapshot_seq);
+    }
+}
+
+void last_states_snapshot_free() {
+    free(main_config.last_states_snapshot);
+    main_config.last_states_snapshot = NULL;
+}
+
+static const uint8_t* last_states_snapshot_find(const uint16_t ch_state_id, const uint8_t ch_type, uint16_t* len) {
+    if (main_config.last_states_snapshot) {
+        const bool is_version_1 = (main_config.last_states_snapshot[0] == LAST_STATES_SNAPSHOT_VERSION_1);
+        const unsigned int entry_size = is_version_1 ? LAST_STATES_SNAPSHOT_ENTRY_SIZE_1 : LAST_STATES_SNAPSHOT_ENTRY_SIZE;
+        const uint8_t* entry = main_config.last_states_snapshot + LAST_STATES_SNAPSHOT_HEADER_SIZE;
+        const uint8_t* end = main_config.last_states_snapshot + main_config.last_states_snapshot_len;
+        
+        while (entry + entry_size <= end) {
+            uint16_t entry_id;
+            memcpy(&entry_id, entry, sizeof(entry_id));
+            
+            uint16_t entry_len = entry[3];
+            if (!is_version_1) {
+                memcpy(&entry_len, entry + 3, sizeof(entry_len));
+            }
+            
+            if (entry + entry_size + entry_len > end) {
+                break;
+            }
+            
+            if (entry_id == ch_state_id && entry[2] == ch_type) {
+                *len = entry_len;
+                return entry + entry_size;
+            }
+            
+            entry += entry_size + entry_len;
+        }
+    }
+    
+    return NULL;
+}
+#endif
+
+// Saved state readers, used by set_initial_state_data()
+sysparam_status_t last_state_get_int8(const uint16_t ch_state_id, const char* saved_state_id, int8_t* result) {
+#ifdef LAST_STATES_SNAPSHOT
+    uint16_t len;
+    const uint8_t* value = last_states_snapshot_find(ch_state_id, CH_TYPE_INT8, &len);
+    if (value && len == sizeof(int8_t)) {
+        *result = (int8_t) value[0];
+        return SYSPARAM_OK;
+    }
+    
+    if (sysparam_get_int8(saved_state_id, result) == SYSPARAM_OK) {
+        main_config.last_states_legacy = true;
+        return SYSPARAM_OK;
+    }
+    
+    return SYSPARAM_NOTFOUND;
+#else
+    return sysparam_get_int8(saved_state_id, result);
+#endif
+}
+
+sysparam_status_t last_state_get_int32(const uint16_t ch_state_id, const uint8_t ch_type, const char* saved_state_id, int32_t* result) {
+#ifdef LAST_STATES_SNAPSHOT
+    uint16_t len;
+    const uint8_t* value = last_states_snapshot_find(ch_state_id, ch_type, &len);
+    if (value && len == sizeof(int32_t)) {
+        memcpy(result, value, sizeof(int32_t));
+        return SYSPARAM_OK;
+    }
+    
+    if (sysparam_get_int32(saved_state_id, result) == SYSPARAM_OK) {
+        main_config.last_states_legacy = true;
+        return SYSPARAM_OK;
+    }
+    
+    return SYSPARAM_NOTFOUND;
+#else
+    return sysparam_get_int32(saved_state_id, result);
+#endif
+}
+
+sysparam_status_t last_state_get_string(const uint16_t ch_state_id, const char* saved_state_id, char** result) {
+#ifdef LAST_STATES_SNAPSHOT
+    uint16_t len;
+    const uint8_t* value = last_states_snapshot_find(ch_state_id, CH_TYPE_STRING, &len);
+    if (value) {
+        *result = malloc(len + 1);
+        if (!*result) {
+            return SYSPARAM_ERR_NOMEM;
+        }
+        memcpy(*result, value, len);
+        (*result)[len] = 0;
+        return SYSPARAM_OK;
+    }
+    
+    if (sysparam_get_string(saved_state_id, result) == SYSPARAM_OK) {
+        main_config.last_states_legacy = true;
+        return SYSPARAM_OK;
+    }
+    
+    return SYSPARAM_NOTFOUND;
+#else
+    return sysparam_get_string(saved_state_id, result);
+#endif
+}
+
+sysparam_status_t last_state_get_bool(const uint16_t ch_state_id, const uint8_t ch_type, const char* saved_state_id, bool* result) {
+#ifdef LAST_STATES_SNAPSHOT
+    uint16_t len;
+    const uint8_t* value = last_states_snapshot_find(ch_state_id, ch_type, &len);
+    if (value && len == 1) {
+        *result = value[0];
+        return SYSPARAM_OK;
+    }
+    
+    if (sysparam_get_bool(saved_state_id, result) == SYSPARAM_OK) {
+        main_config.last_states_legacy = true;
+        return SYSPARAM_OK;
+    }
+    
+    return SYSPARAM_NOTFOUND;
+#else
+    return sysparam_get_bool(saved_state_id, result);
+#endif
+}
+
+#ifdef LAST_STATES_SNAPSHOT
+void last_states_legacy_erase() {
+    // Old format keys are not read anymore once a snapshot exists
+    last_state_t* last_state = main_config.last_states;
+    while (last_state) {
+        char saved_state_id[8];
+        itoa(last_state->ch_state_id, saved_state_id, 10);
+        sysparam_erase(saved_state_id);
+        last_state = last_state->next;
+    }
+    
+    main_config.last_states_legacy = false;
+}
+
+void save_states() {
+    INFO("Saving");
+    
+    size_t len = LAST_STATES_SNAPSHOT_HEADER_SIZE + LAST_STATES_SNAPSHOT_CRC_SIZE;
+    uint16_t count = 0;
+    last_state_t* last_state = main_config.last_states;
+    
+    while (last_state) {
+        if (last_state->ch_type == CH_TYPE_STRING) {
+            len += LAST_STATES_SNAPSHOT_ENTRY_SIZE + HAA_MIN(strlen(last_state->ch->value.string_value), UINT16_MAX);
+        } else {
+            len += LAST_STATES_SNAPSHOT_ENTRY_SIZE + sizeof(int32_t);
+        }
+        
+        count++;
+        last_state = last_state->next;
+    }
+    
+    uint8_t* snapshot = malloc(len);
+    if (!snapshot) {
+        ERROR("Snapshot mem");
+        return;
+    }
+    
+    uint8_t* entry = snapshot + LAST_STATES_SNAPSHOT_HEADER_SIZE;
+    last_state = main_config.last_states;
+    
+    while (last_state) {
+        uint16_t value_len;
+        int32_t int_value;
+        
+        memcpy(entry, &last_state->ch_state_id, sizeof(uint16_t));
+        entry[2] = last_state->ch_type;
+        
+        switch (last_state->ch_type) {
+            case CH_TYPE_INT8:
+                entry[LAST_STATES_SNAPSHOT_ENTRY_SIZE] = (int8_t) last_state->ch->value.int_value;
+                value_len = sizeof(int8_t);
+                break;
+                
+            case CH_TYPE_INT:
+                int_value = last_state->ch->value.int_value;
+                memcpy(entry + LAST_STATES_SNAPSHOT_ENTRY_SIZE, &int_value, sizeof(int32_t));
+                value_len = sizeof(int32_t);
+                break;
+                
+            case CH_TYPE_FLOAT:
+                int_value = last_state->ch->value.float_value * FLOAT_FACTOR_SAVE_AS_INT;
+                memcpy(entry + LAST_STATES_SNAPSHOT_ENTRY_SIZE, &int_value, sizeof(int32_t));
+                value_len = sizeof(int32_t);
+                break;
+                
+            case CH_TYPE_STRING:
+                value_len = HAA_MIN(strlen(last_state->ch->value.string_value), UINT16_MAX);
+                memcpy(entry + LAST_STATES_SNAPSHOT_ENTRY_SIZE, last_state->ch->value.string_value, value_len);
+                break;
+                
+            default:    // case CH_TYPE_BOOL
+                entry[LAST_STATES_SNAPSHOT_ENTRY_SIZE] = last_state->ch->value.bool_value;
+                value_len = 1;
+                break;
         }
         
-        xSemaphoreGive(main_config.network_busy_mutex);
+        memcpy(entry + 3, &value_len, sizeof(value_len));
+        entry += LAST_STATES_SNAPSHOT_ENTRY_SIZE + value_len;
+        last_state = last_state->next;
     }
     
-    vTaskDelete(NULL);
-}
-
-void ping_task_timer_worker() {
-    if (!homekit_is_pairing()) {
-        if (xTaskCreate(ping_task, "PIN", PING_TASK_SIZE, NULL, PING_TASK_PRIORITY, NULL) != pdPASS) {
-            homekit_remove_oldest_client();
-            ERROR("PIN");
-        }
-    } else {
-        ERROR("PING pair %i", homekit_is_pairing());
+    len = entry - snapshot;
+    
+    // Nothing changed since last snapshot
+    const uint32_t states_crc = haa_crc32(snapshot + LAST_STATES_SNAPSHOT_HEADER_SIZE, len - LAST_STATES_SNAPSHOT_HEADER_SIZE);
+    if (main_config.last_states_snapshot_seq > 0 && states_crc == main_config.last_states_snapshot_crc) {
+        free(snapshot);
+        return;
     }
-}
-
-// -----
-
-void setup_mode_call(const uint16_t gpio, void* args, const uint8_t param) {
-    INFO("Setup");
     
-    if (main_config.setup_mode_time == 0 || xTaskGetTickCount() < main_config.setup_mode_time * (1000 / portTICK_PERIOD_MS)) {
-        sysparam_set_int8(HAA_SETUP_MODE_SYSPARAM, 1);
-        reboot_haa();
+    const uint32_t seq = main_config.last_states_snapshot_seq + 1;
+    snapshot[0] = LAST_STATES_SNAPSHOT_VERSION;
+    snapshot[1] = 0;
+    memcpy(snapshot + 2, &count, sizeof(count));
+    memcpy(snapshot + 4, &seq, sizeof(seq));
+    
+    const uint32_t crc = haa_crc32(snapshot, len);
+    memcpy(snapshot + len, &crc, sizeof(crc));
+    len += LAST_STATES_SNAPSHOT_CRC_SIZE;
+    
+    // Never overwrite the last good snapshot
+    const char* snapshot_key = (seq & 1) ? LAST_STATES_SNAPSHOT_SYSPARAM_B : LAST_STATES_SNAPSHOT_SYSPARAM_A;
+    size_t written = len;
+    int status;
+    
+#ifndef ESP_PLATFORM
+    // Snapshot and erasing of old format keys are written in a single batch
+    const unsigned int items_count = 1 + (main_config.last_states_legacy ? count : 0);
+    sysparam_batch_item_t* items = calloc(items_count, sizeof(sysparam_batch_item_t));
+    char (*saved_state_ids)[8] = NULL;
+    if (items_count > 1) {
+        saved_state_ids = malloc((items_count - 1) * sizeof(*saved_state_ids));
+    }
+    
+    if (items && (items_count == 1 || saved_state_ids)) {
+        items[0].key = snapshot_key;
+        items[0].value = snapshot;
+        items[0].value_len = len;
+        items[0].binary = true;
+        
+        unsigned int i = 1;
+        last_state = main_config.last_states;
+        while (i < items_count && last_state) {
+            itoa(last_state->ch_state_id, saved_state_ids[i - 1], 10);
+            items[i].key = saved_state_ids[i - 1];
+            i++;
+            last_state = last_state->next;
+        }
+        
+        status = sysparam_set_batch(items, i, &written);
+        if (status == SYSPARAM_OK) {
+            main_config.last_states_legacy = false;
+        }
     } else {
-        ERROR("Not after %is", main_config.setup_mode_time);
+        status = sysparam_set_blob(snapshot_key, snapshot, len);
     }
-}
-
-void setup_mode_toggle_upcount(ch_group_t* ch_group) {
-    if (ch_group->homekit_enabled && main_config.setup_mode_toggle_counter_max > 0) {
-        main_config.setup_mode_toggle_counter++;
-        INFO("Setup %i/%i", main_config.setup_mode_toggle_counter, main_config.setup_mode_toggle_counter_max);
+    
+    free(items);
+    free(saved_state_ids);
+#else
+    status = sysparam_set_blob(snapshot_key, snapshot, len);
+#endif
+    
+    free(snapshot);
+    
+    if (status == SYSPARAM_OK) {
+        main_config.last_states_snapshot_seq = seq;
+        main_config.last_states_snapshot_crc = states_crc;
+        INFO("Saved %i states, %i bytes", count, written);
         
-        if (main_config.setup_mode_toggle_counter == main_config.setup_mode_toggle_counter_max) {
-            setup_mode_call(99, NULL, 0);
-        } else {
-            rs_esp_timer_start(main_config.setup_mode_toggle_timer);
+        if (main_config.last_states_legacy) {
+            last_states_legacy_erase();
         }
+    } else {
+        ERROR("Saving %i", status);
     }
 }
 
-void setup_mode_toggle() {
-    main_config.setup_mode_toggle_counter = 0;
-}
+#else   // LAST_STATES_SNAPSHOT
 
-// -----
 void save_states() {
     INFO("Saving");
     last_state_t* last_state = main_config.last_states;
     
+#ifndef ESP_PLATFORM
+    unsigned int states_count = 0;
+    while (last_state) {
+        states_count++;
+        last_state = last_state->next;
+    }
+    
+    sysparam_batch_item_t* items = malloc(states_count * sizeof(sysparam_batch_item_t));
+    union {
+        int32_t int_value;
+        int8_t int8_value;
+        char bool_value;
+    }* values = malloc(states_count * sizeof(*values));
+    char (*saved_state_ids)[8] = malloc(states_count * sizeof(*saved_state_ids));
+    
+    if (items && values && saved_state_ids) {
+        unsigned int i = 0;
+        last_state = main_config.last_states;
+        
+        while (last_state) {
+            itoa(last_state->ch_state_id, saved_state_ids[i], 10);
+            items[i].key = saved_state_ids[i];
+            items[i].binary = true;
+            
+            switch (last_state->ch_type) {
+                case CH_TYPE_INT8:
+                    values[i].int8_value = last_state->ch->value.int_value;
+                    items[i].value = (uint8_t*) &values[i].int8_value;
+                    items[i].value_len = sizeof(int8_t);
+                    break;
+                    
+                case CH_TYPE_INT:
+                    values[i].int_value = last_state->ch->value.int_value;
+                    items[i].value = (uint8_t*) &values[i].int_value;
+                    items[i].value_len = sizeof(int32_t);
+                    break;
+                    
+                case CH_TYPE_FLOAT:
+                    values[i].int_value = last_state->ch->value.float_value * FLOAT_FACTOR_SAVE_AS_INT;
+                    items[i].value = (uint8_t*) &values[i].int_value;
+                    items[i].value_len = sizeof(int32_t);
+                    break;
+                    
+                case CH_TYPE_STRING:
+                    items[i].value = (uint8_t*) last_state->ch->value.string_value;
+                    items[i].value_len = strlen(last_state->ch->value.string_value);
+                    items[i].binary = false;
+                    break;
+                    
+                default:    // case CH_TYPE_BOOL
+                    // Same encoding as sysparam_set_bool()
+                    values[i].bool_value = last_state->ch->value.bool_value ? 'y' : 'n';
+                    items[i].value = (uint8_t*) &values[i].bool_value;
+                    items[i].value_len = 1;
+                    items[i].binary = false;
+                    break;
+            }
+            
+            i++;
+            last_state = last_state->next;
+        }
+        
+        size_t written = 0;
+        const int status = sysparam_set_batch(items, states_count, &written);
+        if (status == SYSPARAM_OK) {
+            INFO("Saved %i bytes", written);
+        } else {
+            ERROR("Saving %i", status);
+        }
+        
+        free(items);
+        free(values);
+        free(saved_state_ids);
+        return;
+    }
+    
+    free(items);
+    free(values);
+    free(saved_state_ids);
+    
+    // Not enough memory for a batch, save states one by one
+    last_state = main_config.last_states;
+#endif
+    
     while (last_state) {
         char saved_state_id[8];
         itoa(last_state->ch_state_id, saved_state_id, 10);
@@ -1374,6 +2837,8 @@ void save_states() {
     }
 }
 
+#endif  // LAST_STATES_SNAPSHOT
+
 void save_states_callback(ch_group_t* ch_group) {
     if (ch_group->save_last_state) {
         rs_esp_timer_start(SAVE_STATES_TIMER);
@@ -1437,8 +2902,19 @@ void hkc_custom_setup_advanced_setter(homekit_characteristic_t* ch, const homeki
         void save_new_script() {
             homekit_value_destruct(&ch->value);
             char* new_script = string_value + CUSTOM_HAA_ADVANCED_COMMAND_LEN;
-            sysparam_set_string(HAA_SCRIPT_SYSPARAM, new_script);
+            
+            // Pending save would write old states again before reboot
+            if (main_config.last_states && SAVE_STATES_TIMER) {
+                rs_esp_timer_stop(SAVE_STATES_TIMER);
+            }
+            
             haa_remove_saved_states();
+            
+#ifdef CONFIG_CACHE
+            sysparam_erase(CONFIG_CACHE_SYSPARAM);
+#endif
+            
+            sysparam_set_string(HAA_SCRIPT_SYSPARAM, new_script);
         }
         
         if (selected_advanced_opt == 1) {
@@ -1934,18 +3410,24 @@ void power_monitor_task(void* args) {
     }
     
     ch_group->is_working = false;
+    poll_task_give();
     
     vTaskDelete(NULL);
 }
 
-void power_monitor_timer_worker(TimerHandle_t xTimer) {
+void power_monitor_timer_worker(void* args) {
     if (!homekit_is_pairing()) {
-        ch_group_t* ch_group = (ch_group_t*) pvTimerGetTimerID(xTimer);
+        ch_group_t* ch_group = (ch_group_t*) args;
         if (ch_group->main_enabled) {
             if (!ch_group->is_working) {
+                if (!poll_task_take(power_monitor_timer_worker, args)) {
+                    return;
+                }
+                
                 ch_group->is_working = true;
                 if (xTaskCreate(power_monitor_task, "PM", POWER_MONITOR_TASK_SIZE, (void*) ch_group, POWER_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
                     ch_group->is_working = false;
+                    poll_task_give();
                     homekit_remove_oldest_client();
                     ERROR("PM");
                 }
@@ -3252,16 +4734,23 @@ void temperature_task(void* args) {
         ch_group_find_by_serv(iairzoning)->is_working = false;
     }
     
+    poll_task_give();
+    
     vTaskDelete(NULL);
 }
 
-void temperature_timer_worker(TimerHandle_t xTimer) {
+void temperature_timer_worker(void* args) {
     if (!homekit_is_pairing()) {
-        ch_group_t* ch_group = (ch_group_t*) pvTimerGetTimerID(xTimer);
+        ch_group_t* ch_group = (ch_group_t*) args;
         if (!ch_group->is_working) {
+            if (!poll_task_take(temperature_timer_worker, args)) {
+                return;
+            }
+            
             ch_group->is_working = true;
             if (xTaskCreate(temperature_task, "TEM", TEMPERATURE_TASK_SIZE, (void*) ch_group, TEMPERATURE_TASK_PRIORITY, NULL) != pdPASS) {
                 ch_group->is_working = false;
+                poll_task_give();
                 homekit_remove_oldest_client();
                 ERROR("TEM");
             }
@@ -4809,17 +6298,23 @@ void light_sensor_task(void* args) {
     }
     
     ch_group->is_working = false;
+    poll_task_give();
     
     vTaskDelete(NULL);
 }
 
-void light_sensor_timer_worker(TimerHandle_t xTimer) {
+void light_sensor_timer_worker(void* args) {
     if (!homekit_is_pairing()) {
-        ch_group_t* ch_group = (ch_group_t*) pvTimerGetTimerID(xTimer);
+        ch_group_t* ch_group = (ch_group_t*) args;
         if (!ch_group->is_working) {
+            if (!poll_task_take(light_sensor_timer_worker, args)) {
+                return;
+            }
+            
             ch_group->is_working = true;
             if (xTaskCreate(light_sensor_task, "LUX", LIGHT_SENSOR_TASK_SIZE, (void*) ch_group, LIGHT_SENSOR_TASK_PRIORITY, NULL) != pdPASS) {
                 ch_group->is_working = false;
+                poll_task_give();
                 homekit_remove_oldest_client();
                 ERROR("LUX");
             }
@@ -5296,12 +6791,484 @@ void IRAM fm_pwm_interrupt(const uint8_t gpio) {
                     }
                     break;
             }
-            
-            break;
+            
+            break;
+        }
+        
+        ch_group = ch_group->next;
+    }
+}
+
+// Free monitor maths chains are compiled once after config load, resolving
+// characteristic and constant operands, so evaluation is a flat loop
+void fm_maths_free(fm_maths_t* fm_maths, const unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (fm_maths->ops[i].source == FM_MATHS_SOURCE_NONE) {
+            free(fm_maths->ops[i].window);
+        }
+    }
+    
+    free(fm_maths);
+}
+
+fm_maths_t* fm_maths_compile(ch_group_t* ch_group) {
+    const unsigned int count = FM_MATHS_OPERATIONS;
+    
+    fm_maths_t* fm_maths = malloc(sizeof(fm_maths_t) + (count * sizeof(fm_maths_op_t)));
+    if (!fm_maths) {
+        return NULL;
+    }
+    
+    fm_maths->count = count;
+    fm_maths->start_zero = (count == 0 || FM_MATHS_INT[FM_MATHS_FIRST_OPERATION] == FM_MATHS_OPERATION_NONE);
+    
+    unsigned int int_index = FM_MATHS_FIRST_OPERATION;
+    unsigned int float_index = FM_MATHS_FLOAT_FIRST;
+    for (unsigned int i = 0; i < count; i++) {
+        fm_maths_op_t* op = &fm_maths->ops[i];
+        op->operation = FM_MATHS_INT[int_index];
+        const int read_service = FM_MATHS_INT[int_index + 1];
+        
+        if (op->operation >= FM_MATHS_OPERATION_WINDOW_MIN &&
+            op->operation <= FM_MATHS_OPERATION_WINDOW_STDDEV) {
+            unsigned int size = FM_MATHS_FLOAT[float_index];
+            if (size == 0) {
+                size = 1;
+            } else if (size > FM_MATHS_WINDOW_SIZE_MAX) {
+                size = FM_MATHS_WINDOW_SIZE_MAX;
+            }
+            
+            // Samples ring, followed by sorted copy or deque slots if needed
+            size_t window_size = sizeof(fm_maths_window_t) + (size * sizeof(float));
+            if (op->operation == FM_MATHS_OPERATION_WINDOW_MEDIAN) {
+                window_size += size * sizeof(float);
+            } else if (op->operation <= FM_MATHS_OPERATION_WINDOW_MAX) {
+                window_size += size;
+            }
+            
+            fm_maths_window_t* window = calloc(1, window_size);
+            if (!window) {
+                fm_maths_free(fm_maths, i);
+                return NULL;
+            }
+            
+            window->size = size;
+            if (op->operation == FM_MATHS_OPERATION_WINDOW_MEDIAN) {
+                window->sorted = &window->samples[size];
+            } else if (op->operation <= FM_MATHS_OPERATION_WINDOW_MAX) {
+                window->deque = (uint8_t*) &window->samples[size];
+            }
+            
+            op->source = FM_MATHS_SOURCE_NONE;
+            op->window = window;
+            
+        } else if (read_service > 0) {
+            ch_group_t* ch_group_read = ch_group_find_by_serv(read_service);
+            const unsigned int ch_index = (uint8_t) FM_MATHS_FLOAT[float_index];
+            if (!ch_group_read || ch_index >= ch_group_read->chs || !ch_group_read->ch[ch_index]) {
+                ERROR("<%i> Maths %i", ch_group->serv_index, i);
+                fm_maths_free(fm_maths, i);
+                return NULL;
+            }
+            
+            // Format of a characteristic never changes, so value is read directly
+            homekit_characteristic_t* ch = ch_group_read->ch[ch_index];
+            switch (ch->value.format) {
+                case HOMEKIT_FORMAT_BOOL:
+                    op->source = FM_MATHS_SOURCE_BOOL;
+                    op->bool_value = &ch->value.bool_value;
+                    break;
+                    
+                case HOMEKIT_FORMAT_UINT8:
+                case HOMEKIT_FORMAT_UINT16:
+                case HOMEKIT_FORMAT_UINT32:
+                case HOMEKIT_FORMAT_UINT64:
+                case HOMEKIT_FORMAT_INT:
+                    op->source = FM_MATHS_SOURCE_INT;
+                    op->int_value = &ch->value.int_value;
+                    break;
+                    
+                case HOMEKIT_FORMAT_FLOAT:
+                    op->source = FM_MATHS_SOURCE_FLOAT;
+                    op->float_value = &ch->value.float_value;
+                    break;
+                    
+                default:
+                    op->source = FM_MATHS_SOURCE_CONSTANT;
+                    op->constant = 0;
+                    break;
+            }
+            
+        } else {
+            // Unknown sources read uptime
+            op->source = read_service;
+#ifdef ESP_PLATFORM
+            if (read_service < FM_MATHS_GET_WIFI_RSSI) {
+#else
+            if (read_service <= FM_MATHS_GET_WIFI_RSSI) {
+#endif
+                op->source = FM_MATHS_GET_UPTIME;
+            }
+            
+            // Constant value or random number limit
+            op->constant = FM_MATHS_FLOAT[float_index];
+        }
+        
+        int_index += 2;
+        float_index++;
+    }
+    
+    return fm_maths;
+}
+
+// Mean and deviations are updated incrementally and rebuilt on every ring
+// wrap, so float rounding does not accumulate
+void fm_maths_window_moments(fm_maths_window_t* window) {
+    double sum = 0;
+    for (unsigned int i = 0; i < window->count; i++) {
+        sum += window->samples[i];
+    }
+    
+    window->mean = sum / window->count;
+    window->m2 = 0;
+    
+    for (unsigned int i = 0; i < window->count; i++) {
+        const double delta = window->samples[i] - window->mean;
+        window->m2 += delta * delta;
+    }
+}
+
+// Binary search of first sorted sample greater than value, or greater or equal if is_lower
+unsigned int fm_maths_window_sorted_find(fm_maths_window_t* window, const unsigned int count, const float value, const bool is_lower) {
+    unsigned int low = 0;
+    unsigned int high = count;
+    while (low < high) {
+        const unsigned int middle = (low + high) >> 1;
+        if (window->sorted[middle] < value || (!is_lower && window->sorted[middle] == value)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+void fm_maths_window_sorted_update(fm_maths_window_t* window, const bool is_full, const float old_sample, const float value) {
+    unsigned int count = window->count;
+    if (is_full) {
+        const unsigned int index = fm_maths_window_sorted_find(window, count, old_sample, true);
+        if (index < count) {
+            count--;
+            memmove(&window->sorted[index], &window->sorted[index + 1], (count - index) * sizeof(float));
+        }
+    }
+    
+    const unsigned int index = fm_maths_window_sorted_find(window, count, value, false);
+    memmove(&window->sorted[index + 1], &window->sorted[index], (count - index) * sizeof(float));
+    window->sorted[index] = value;
+}
+
+// Sliding window statistics: min and max use a monotonic deque and avg and stddev
+// use running moments, all amortized O(1). Median keeps a sorted copy, O(log n) search
+// plus a memmove of at most FM_MATHS_WINDOW_SIZE_MAX samples
+float fm_maths_window_reduce(fm_maths_window_t* window, const unsigned int operation, const float value) {
+    const unsigned int slot = window->head;
+    const unsigned int is_full = (window->count == window->size);
+    const float old_sample = window->samples[slot];
+    
+    switch (operation) {
+        case FM_MATHS_OPERATION_WINDOW_MIN:
+        case FM_MATHS_OPERATION_WINDOW_MAX:
+            // Oldest sample leaves window; if still a candidate, it is the first one
+            if (is_full && window->deque_count > 0 && window->deque[window->deque_first] == slot) {
+                window->deque_first = (window->deque_first + 1) % window->size;
+                window->deque_count--;
+            }
+            
+            while (window->deque_count > 0) {
+                const float last = window->samples[window->deque[(window->deque_first + window->deque_count - 1) % window->size]];
+                if ((operation == FM_MATHS_OPERATION_WINDOW_MIN && last < value) ||
+                    (operation == FM_MATHS_OPERATION_WINDOW_MAX && last > value)) {
+                    break;
+                }
+                
+                window->deque_count--;
+            }
+            
+            window->deque[(window->deque_first + window->deque_count) % window->size] = slot;
+            window->deque_count++;
+            break;
+            
+        case FM_MATHS_OPERATION_WINDOW_MEDIAN:
+            fm_maths_window_sorted_update(window, is_full, old_sample, value);
+            break;
+            
+        default:    // case FM_MATHS_OPERATION_WINDOW_AVG:
+                    // case FM_MATHS_OPERATION_WINDOW_STDDEV:
+            // Welford update, replacing oldest sample when window is full
+            if (is_full) {
+                const double old_mean = window->mean;
+                window->mean += ((double) value - old_sample) / window->count;
+                window->m2 += ((double) value - old_sample) * (value - window->mean + old_sample - old_mean);
+            } else {
+                const double delta = value - window->mean;
+                window->mean += delta / (window->count + 1);
+                window->m2 += delta * (value - window->mean);
+            }
+            break;
+    }
+    
+    window->samples[slot] = value;
+    window->head = (slot + 1) % window->size;
+    if (!is_full) {
+        window->count++;
+    }
+    
+    const unsigned int count = window->count;
+    switch (operation) {
+        case FM_MATHS_OPERATION_WINDOW_MIN:
+        case FM_MATHS_OPERATION_WINDOW_MAX:
+            return window->samples[window->deque[window->deque_first]];
+            
+        case FM_MATHS_OPERATION_WINDOW_MEDIAN:
+            if (count & 1) {
+                return window->sorted[count >> 1];
+            }
+            
+            return (window->sorted[(count >> 1) - 1] + window->sorted[count >> 1]) / 2;
+            
+        default:
+            if (window->head == 0) {
+                fm_maths_window_moments(window);
+            }
+            
+            if (operation == FM_MATHS_OPERATION_WINDOW_AVG) {
+                return window->mean;
+            }
+            
+            // Population standard deviation
+            if (window->m2 <= 0) {
+                return 0;
+            }
+            
+            return sqrt(window->m2 / count);
+    }
+}
+
+bool fm_maths_run(ch_group_t* ch_group, float* result) {
+    fm_maths_t* fm_maths = ch_group->fm_maths;
+    if (!fm_maths) {
+        return false;
+    }
+    
+    const float last_value = ch_group->ch[0]->value.float_value;
+    float value = fm_maths->start_zero ? 0 : last_value;
+    
+    // Time is read once per evaluation, only if any operation needs it
+    time_t time = 0;
+    struct tm* timeinfo = NULL;
+    
+    const fm_maths_op_t* op = fm_maths->ops;
+    const fm_maths_op_t* const op_end = op + fm_maths->count;
+    for (; op < op_end; op++) {
+        float read_value = 0;
+        if (op->source == FM_MATHS_SOURCE_CONSTANT) {
+            read_value = op->constant;
+            
+        } else {
+            switch (op->source) {
+                case FM_MATHS_SOURCE_FLOAT:
+                    read_value = *op->float_value;
+                    break;
+                    
+                case FM_MATHS_SOURCE_INT:
+                    read_value = *op->int_value;
+                    break;
+                    
+                case FM_MATHS_SOURCE_BOOL:
+                    read_value = (*op->bool_value == true);
+                    break;
+                    
+                case FM_MATHS_SOURCE_NONE:
+                    break;
+                    
+                case FM_MATHS_GEN_RANDOM_NUMBER:
+                    read_value = hwrand() % (((uint32_t) op->constant) + 1);
+                    break;
+                    
+                case FM_MATHS_GET_UPTIME:
+                    read_value = xTaskGetTickCount() / (1000 / portTICK_PERIOD_MS);
+                    break;
+                    
+#ifdef ESP_PLATFORM
+                case FM_MATHS_GET_WIFI_RSSI:
+                    int wifi_rssi = 0;
+                    if (esp_wifi_sta_get_rssi(&wifi_rssi) != ESP_OK) {
+                        return false;
+                    }
+                    read_value = wifi_rssi;
+                    break;
+                    
+#endif
+                default:    // FM_MATHS_GET_TIME_*
+                    if (!timeinfo) {
+                        if (!main_config.clock_ready) {
+                            return false;
+                        }
+                        
+                        time = raven_ntp_get_time();
+                        timeinfo = localtime(&time);
+                    }
+                    
+                    switch (op->source) {
+                        case FM_MATHS_GET_TIME_HOUR:
+                            read_value = timeinfo->tm_hour;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_MINUTE:
+                            read_value = timeinfo->tm_min;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_SECOND:
+                            read_value = timeinfo->tm_sec;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_DAYWEEK:
+                            read_value = timeinfo->tm_wday;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_DAYMONTH:
+                            read_value = timeinfo->tm_mday;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_MONTH:
+                            read_value = timeinfo->tm_mon;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_YEAR:
+                            read_value = timeinfo->tm_year;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_DAYYEAR:
+                            read_value = timeinfo->tm_yday;
+                            break;
+                            
+                        case FM_MATHS_GET_TIME_IS_SAVING:
+                            read_value = timeinfo->tm_isdst;
+                            break;
+                            
+                        default:    // case FM_MATHS_GET_TIME_UNIX:
+                            read_value = time;
+                            break;
+                    }
+                    break;
+            }
         }
         
-        ch_group = ch_group->next;
+        switch (op->operation) {
+            case FM_MATHS_OPERATION_SUB:
+                value = value - read_value;
+                break;
+                
+            case FM_MATHS_OPERATION_SUB_INV:
+                value = read_value - value;
+                break;
+                
+            case FM_MATHS_OPERATION_MUL:
+                value = value * read_value;
+                break;
+                
+            case FM_MATHS_OPERATION_DIV:
+                if (read_value == 0) {
+                    return false;
+                }
+                
+                value = value / read_value;
+                break;
+                
+            case FM_MATHS_OPERATION_DIV_INV:
+                if (value == 0) {
+                    return false;
+                }
+                
+                value = read_value / value;
+                break;
+                
+            case FM_MATHS_OPERATION_MOD:
+                if (((int) read_value) == 0) {
+                    return false;
+                }
+                
+                value = ((int) value) % ((int) read_value);
+                break;
+                
+            case FM_MATHS_OPERATION_MOD_INV:
+                if (((int) value) == 0) {
+                    return false;
+                }
+                
+                value = ((int) read_value) % ((int) value);
+                break;
+                
+            case FM_MATHS_OPERATION_POW:
+                value = HAA_POW(value, read_value);
+                break;
+                
+            case FM_MATHS_OPERATION_POW_INV:
+                value = HAA_POW(read_value, value);
+                break;
+                
+            case FM_MATHS_OPERATION_INV:
+                if (value == 0) {
+                    return false;
+                }
+                
+                value = 1 / value;
+                break;
+                
+            case FM_MATHS_OPERATION_ABS:
+                value = fabs(value);
+                break;
+                
+            case FM_MATHS_OPERATION_EMA_LPFILTER:
+                value = (read_value * value) + ((1.f - read_value) * last_value);
+                break;
+                
+            case FM_MATHS_OPERATION_EMA_HPFILTER:
+                value -= (read_value * value) + ((1.f - read_value) * last_value);
+                break;
+                
+            case FM_MATHS_OPERATION_MIN:
+                if (read_value < value) {
+                    value = read_value;
+                }
+                break;
+                
+            case FM_MATHS_OPERATION_MAX:
+                if (read_value > value) {
+                    value = read_value;
+                }
+                break;
+                
+            case FM_MATHS_OPERATION_WINDOW_MIN:
+            case FM_MATHS_OPERATION_WINDOW_MAX:
+            case FM_MATHS_OPERATION_WINDOW_AVG:
+            case FM_MATHS_OPERATION_WINDOW_MEDIAN:
+            case FM_MATHS_OPERATION_WINDOW_STDDEV:
+                value = fm_maths_window_reduce(op->window, op->operation, value);
+                break;
+                
+            default:    // case FM_MATHS_OPERATION_NONE:
+                        // case FM_MATHS_OPERATION_ADD:
+                value = value + read_value;
+                break;
+        }
     }
+    
+    *result = value;
+    
+    return true;
 }
 
 bool free_monitor_type_is_pattern(const uint8_t fm_sensor_type) {
@@ -5455,192 +7422,7 @@ void free_monitor_task(void* args) {
                     }
                     
                 } else if (fm_sensor_type == FM_SENSOR_TYPE_MATHS) {
-                    unsigned int float_index = FM_MATHS_FLOAT_FIRST + (FM_SENSOR_TYPE < 0 ? 2 : 0);
-                    unsigned int int_index = FM_MATHS_FIRST_OPERATION;
-                    get_value = true;
-                    
-                    for (int i = 0; i < FM_MATHS_OPERATIONS; i++) {
-                        const unsigned int operation = FM_MATHS_INT[int_index];
-                        int_index++;
-                        const int read_service = FM_MATHS_INT[int_index];
-                        
-                        if (i == 0) {
-                            if (operation == FM_MATHS_OPERATION_NONE) {
-                                value = 0;
-                            } else {
-                                value = ch_group->ch[0]->value.float_value;
-                            }
-                        }
-                        
-                        float read_value;
-                        if (read_service == 0) {
-                            read_value = FM_MATHS_FLOAT[float_index];
-                            
-                        } else if (read_service > 0) {
-                            read_value = get_hkch_value(ch_group_find_by_serv(read_service)->ch[(uint8_t) FM_MATHS_FLOAT[float_index]]);
-                            
-                        } else {
-                            if (read_service >= FM_MATHS_GET_TIME_UNIX) {
-                                if (main_config.clock_ready) {
-                                    struct tm* timeinfo;
-                                    time_t time = raven_ntp_get_time();
-                                    timeinfo = localtime(&time);
-                                    
-                                    switch (read_service) {
-                                        case FM_MATHS_GET_TIME_HOUR:
-                                            read_value = timeinfo->tm_hour;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_MINUTE:
-                                            read_value = timeinfo->tm_min;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_SECOND:
-                                            read_value = timeinfo->tm_sec;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_DAYWEEK:
-                                            read_value = timeinfo->tm_wday;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_DAYMONTH:
-                                            read_value = timeinfo->tm_mday;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_MONTH:
-                                            read_value = timeinfo->tm_mon;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_YEAR:
-                                            read_value = timeinfo->tm_year;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_DAYYEAR:
-                                            read_value = timeinfo->tm_yday;
-                                            break;
-                                            
-                                        case FM_MATHS_GET_TIME_IS_SAVING:
-                                            read_value = timeinfo->tm_isdst;
-                                            break;
-                                            
-                                        default:    // case FM_MATHS_GET_TIME_UNIX:
-                                            read_value = time;
-                                            break;
-                                    }
-                                    
-                                } else {
-                                    get_value = false;
-                                    break;
-                                }
-                                
-                            } else {
-                                switch (read_service) {
-                                    case FM_MATHS_GEN_RANDOM_NUMBER:
-                                        read_value = hwrand() % (((uint32_t) FM_MATHS_FLOAT[float_index]) + 1);
-                                        break;
-#ifdef ESP_PLATFORM
-                                    case FM_MATHS_GET_WIFI_RSSI:
-                                        int wifi_rssi = 0;
-                                        if (esp_wifi_sta_get_rssi(&wifi_rssi) != ESP_OK) {
-                                            get_value = false;
-                                        }
-                                        read_value = wifi_rssi;
-                                        break;
-#endif
-                                    default:    // case FM_MATHS_GET_UPTIME:
-                                        read_value = xTaskGetTickCount() / (1000 / portTICK_PERIOD_MS);
-                                        break;
-                                }
-                            }
-                        }
-                        
-                        switch (operation) {
-                            case FM_MATHS_OPERATION_SUB:
-                                value = value - read_value;
-                                break;
-                                
-                            case FM_MATHS_OPERATION_SUB_INV:
-                                value = read_value - value;
-                                break;
-                                
-                            case FM_MATHS_OPERATION_MUL:
-                                value = value * read_value;
-                                break;
-                                
-                            case FM_MATHS_OPERATION_DIV:
-                                if (read_value == 0) {
-                                    get_value = false;
-                                    break;
-                                }
-                                
-                                value = value / read_value;
-                                break;
-                                
-                            case FM_MATHS_OPERATION_DIV_INV:
-                                if (value == 0) {
-                                    get_value = false;
-                                    break;
-                                }
-                                
-                                value = read_value / value;
-                                break;
-                                
-                            case FM_MATHS_OPERATION_MOD:
-                                if (read_value == 0) {
-                                    get_value = false;
-                                    break;
-                                }
-                                
-                                value = ((int) value) % ((int) read_value);
-                                break;
-                                
-                            case FM_MATHS_OPERATION_MOD_INV:
-                                if (value == 0) {
-                                    get_value = false;
-                                    break;
-                                }
-                                
-                                value = ((int) read_value) % ((int) value);
-                                break;
-                                
-                            case FM_MATHS_OPERATION_POW:
-                                value = HAA_POW(value, read_value);
-                                break;
-                                
-                            case FM_MATHS_OPERATION_POW_INV:
-                                value = HAA_POW(read_value, value);
-                                break;
-                                
-                            case FM_MATHS_OPERATION_INV:
-                                if (value == 0) {
-                                    get_value = false;
-                                    break;
-                                }
-                                
-                                value = 1 / value;
-                                break;
-                                
-                            case FM_MATHS_OPERATION_ABS:
-                                value = fabs(value);
-                                break;
-                                
-                            case FM_MATHS_OPERATION_EMA_LPFILTER:
-                                value = (read_value * value) + ((1.f - read_value) * ch_group->ch[0]->value.float_value);
-                                break;
-                                
-                            case FM_MATHS_OPERATION_EMA_HPFILTER:
-                                value -= (read_value * value) + ((1.f - read_value) * ch_group->ch[0]->value.float_value);
-                                break;
-                                
-                            default:    // case FM_MATHS_OPERATION_NONE:
-                                        // case FM_MATHS_OPERATION_ADD:
-                                value = value + read_value;
-                                break;
-                        }
-
-                        int_index++;
-                        float_index++;
-                    }
+                    get_value = fm_maths_run(ch_group, &value);
                     
                 } else if (fm_sensor_type == FM_SENSOR_TYPE_ADC ||
                          fm_sensor_type == FM_SENSOR_TYPE_ADC_INV) {
@@ -5663,7 +7445,7 @@ void free_monitor_task(void* args) {
                            fm_sensor_type <= FM_SENSOR_TYPE_NETWORK_PATTERN_HEX) {
                     if (ch_group->action_network && main_config.wifi_status == WIFI_STATUS_CONNECTED) {
                         
-                        action_network_t* action_network = ch_group->action_network;
+                        action_network_t* action_network = action_first(ch_group, 0, ACTION_TYPE_NETWORK);
                         
                         while (action_network) {
                             if (action_network->action == 0 && !action_network->is_running) {
@@ -5716,9 +7498,10 @@ void free_monitor_task(void* args) {
                                                 + strlen(http_header1)
                                                 + strlen(action_network->host)
                                                 + strlen(http_header2)
+                                                + strlen(http_header_close)
                                                 + strlen(action_network->header)
                                                 + ((method_req != NULL) ? strlen(method_req) : 0) + content_len_n
-                                                + 4 + 1; // 4 for fixed chars of "%s /%s%s%s%s%s%s\r\n" +1 for last null only used for logs
+                                                + 4 + 1; // 4 for fixed chars of "%s /%s%s%s%s%s%s%s\r\n" +1 for last null only used for logs
                                             
                                             req = (char*) force_alloc(action_network->len);
                                             if (!req) {
@@ -5734,12 +7517,13 @@ void free_monitor_task(void* args) {
                                                 continue;
                                             }
                                             
-                                            snprintf(req, action_network->len, "%s /%s%s%s%s%s%s\r\n",
+                                            snprintf(req, action_network->len, "%s /%s%s%s%s%s%s%s\r\n",
                                                      method,
                                                      action_network->url,
                                                      http_header1,
                                                      action_network->host,
                                                      http_header2,
+                                                     http_header_close,
                                                      action_network->header,
                                                      (method_req != NULL) ? method_req : "");
                                             
@@ -5997,6 +7781,7 @@ void free_monitor_task(void* args) {
     
     if (args) {
         ch_group->is_working = false;
+        poll_task_give();
     } else {
         reset_uart_buffer();
     }
@@ -6004,9 +7789,9 @@ void free_monitor_task(void* args) {
     vTaskDelete(NULL);
 }
 
-void free_monitor_timer_worker(TimerHandle_t xTimer) {
+void free_monitor_timer_worker(void* args) {
     if (!homekit_is_pairing()) {
-        ch_group_t* ch_group = (ch_group_t*) pvTimerGetTimerID(xTimer);
+        ch_group_t* ch_group = (ch_group_t*) args;
         if (ch_group->main_enabled) {
             if (!ch_group->is_working) {
                 ch_group_t* ch_group_b = NULL;
@@ -6029,9 +7814,14 @@ void free_monitor_timer_worker(TimerHandle_t xTimer) {
                 }
                 
                 if (!ch_group_b) {
+                    if (!poll_task_take(free_monitor_timer_worker, args)) {
+                        return;
+                    }
+                    
                     ch_group->is_working = true;
                     if (xTaskCreate(free_monitor_task, "FM", FREE_MONITOR_TASK_SIZE, (void*) ch_group, FREE_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
                         ch_group->is_working = false;
+                        poll_task_give();
                         homekit_remove_oldest_client();
                         ERROR("FM");
                     }
@@ -6358,220 +8148,100 @@ void hkc_autooff_setter_task(TimerHandle_t xTimer) {
     }
 }
 
-// --- Network Action task
-void net_action_task(void* pvParameters) {
-    vTaskDelay(1);
-    
-    action_task_t* action_task = (action_task_t*) pvParameters;
-    
-    action_network_t* action_network = action_task->ch_group->action_network;
-    
-    int socket;
+// --- Network Action job
+// Streams request of a network action to socket. Returns written bytes, or negative on error
+int net_action_write(action_network_t* action_network, const int socket, const unsigned int content_len_n, const bool keep_alive) {
+    char buffer[NETWORK_ACTION_STREAM_BUFFER];
+    net_stream_t stream = {
+        .socket = socket,
+        .size = NETWORK_ACTION_STREAM_BUFFER,
+        .buffer = buffer
+    };
     
-    unsigned int search_str_ch_values(str_ch_value_t** str_ch_value_ini, char* content) {
-        unsigned int len = strlen(content);
+    if (action_network->method_n < 3) { // HTTP
+        net_template_write(&stream, action_network->head, NULL);
         
-        char* content_search = content;
-        str_ch_value_t* str_ch_value_last = NULL;
+        if (action_network->method_n > 0) {
+            char content_len[12];
+            net_stream_write(&stream, http_header_len, sizeof(http_header_len) - 1);
+            net_stream_write(&stream, content_len, snprintf(content_len, sizeof(content_len), "%i\r\n", content_len_n));
+        }
         
-        do {
-            content_search = strstr(content_search, NETWORK_ACTION_WILDCARD_VALUE);
-            if (content_search) {
-                char buffer[15];
-                buffer[2] = 0;
-                
-                buffer[0] = content_search[5];
-                buffer[1] = content_search[6];
-                
-                int acc_number = strtol(buffer, NULL, 10);
-                
-                ch_group_t* ch_group_found = action_task->ch_group;
-                
-                if (acc_number > 0) {
-                    ch_group_found = ch_group_find_by_serv(acc_number);
-                }
-                
-                buffer[0] = content_search[7];
-                buffer[1] = content_search[8];
-                
-                homekit_value_t* value = &ch_group_found->ch[(int) strtol(buffer, NULL, 10)]->value;
-                
-                switch (value->format) {
-                    case HOMEKIT_FORMAT_BOOL:
-                        snprintf(buffer, 15, "%s", value->bool_value ? "true" : "false");
-                        break;
-                        
-                    case HOMEKIT_FORMAT_UINT8:
-                    case HOMEKIT_FORMAT_UINT16:
-                    case HOMEKIT_FORMAT_UINT32:
-                    case HOMEKIT_FORMAT_UINT64:
-                    case HOMEKIT_FORMAT_INT:
-                        snprintf(buffer, 15, "%i", value->int_value);
-                        break;
-                        
-                    case HOMEKIT_FORMAT_FLOAT:
-                        snprintf(buffer, 15, "%1.7g", value->float_value);
-                        break;
-                        
-                    default:
-                        buffer[0] = 0;
-                        break;
-                }
-                
-                len += strlen(buffer) - 9;
-                
-                str_ch_value_t* str_ch_value = calloc(1, sizeof(str_ch_value_t));
-                
-                str_ch_value->string = strdup(buffer);
-                str_ch_value->next = NULL;
-                INFO("Wildcard val: %s", str_ch_value->string);
-                
-                if (*str_ch_value_ini == NULL) {
-                    *str_ch_value_ini = str_ch_value;
-                    str_ch_value_last = str_ch_value;
-                } else {
-                    str_ch_value_last->next = str_ch_value;
-                    str_ch_value_last = str_ch_value;
-                }
-
-                content_search += 9;
-            }
-            
-        } while (content_search);
+        if (!keep_alive) {
+            net_stream_write(&stream, http_header_close, sizeof(http_header_close) - 1);
+        }
         
-        return len;
+        net_stream_write(&stream, "\r\n", 2);
     }
     
-    void write_str_ch_values(str_ch_value_t** str_ch_value_ini, char** new_req, char* content) {
-        if (*str_ch_value_ini) {
-            str_ch_value_t* str_ch_value = *str_ch_value_ini;
-            char* content_search = content;
-            char* last_pos = content;
-            
-            do {
-                content_search = strstr(last_pos, NETWORK_ACTION_WILDCARD_VALUE);
-                
-                if (content_search - last_pos > 0) {
-                    strncat(*new_req, last_pos, content_search - last_pos);
-                }
-                
-                strcat(*new_req, str_ch_value->string);
-                
-                free(str_ch_value->string);
-
-                str_ch_value_t* str_ch_value_old = str_ch_value;
-                str_ch_value = str_ch_value->next;
-                
-                free(str_ch_value_old);
-
-                last_pos = content_search + 9;
-                
-            } while (str_ch_value);
-            
-            strcat(*new_req, last_pos);
-            
-        } else {
-            strcat(*new_req, content);
-        }
+    if (action_network->method_n > 0) {
+        net_template_write(&stream, action_network->body, action_network->body_values);
     }
     
-    while (action_network) {
-        if (action_network->action == action_task->action && !action_network->is_running) {
-            action_network->is_running = true;
-            
-            if (xSemaphoreTake(main_config.network_busy_mutex, MS_TO_TICKS(2000)) == pdTRUE) {
-                INFO("<%i> Net %s:%i", action_task->ch_group->serv_index, action_network->host, action_network->port_n);
-                
-                str_ch_value_t* str_ch_value_first = NULL;
-                
-                if (action_network->method_n < 10) {
-                    unsigned int content_len_n = 0;
-                    
-                    char* req = NULL;
-                    
-                    if (action_network->method_n < 3) { // HTTP
-                        char* method = strdup("GET");
-                        char* method_req = NULL;
-                        if (action_network->method_n > 0) {
-                            content_len_n = search_str_ch_values(&str_ch_value_first, action_network->content);
-                            
-                            char content_len[4];
-                            itoa(content_len_n, content_len, 10);
-                            method_req = malloc(23);
-                            snprintf(method_req, 23, "%s%s\r\n",
-                                     http_header_len,
-                                     content_len);
-                            
-                            free(method);
-                            if (action_network->method_n == 1) {
-                                method = strdup("PUT");
-                            } else {
-                                method = strdup("POST");
-                            }
-                        }
-                        
-                        action_network->len = strlen(method)
-                            + strlen(action_network->url)
-                            + strlen(http_header1)
-                            + strlen(action_network->host)
-                            + strlen(http_header2)
-                            + strlen(action_network->header)
-                            + ((method_req != NULL) ? strlen(method_req) : 0) + content_len_n
-                        + 4 + 1; // 4 for fixed chars of "%s /%s%s%s%s%s%s\r\n" +1 for last null only used for logs
-                        
-                        req = (char*) force_alloc(action_network->len);
-                        if (!req) {
-                            if (method_req) {
-                                free(method_req);
-                            }
-                            
-                            free(method);
-                            
-                            action_network->is_running = false;
-                            action_network = action_network->next;
-                            ERROR("DRAM");
-                            continue;
-                        }
-                        
-                        snprintf(req, action_network->len, "%s /%s%s%s%s%s%s\r\n",
-                                 method,
-                                 action_network->url,
-                                 http_header1,
-                                 action_network->host,
-                                 http_header2,
-                                 action_network->header,
-                                 (method_req != NULL) ? method_req : "");
-                        
-                        free(method);
-                        
-                        if (method_req) {
-                            free(method_req);
-                        }
-                    }
-                    
-                    if (action_network->method_n > 0 &&
-                        action_network->method_n < 4) {
-                        if (action_network->method_n == 3) {
-                            action_network->len = content_len_n + 1;    // +1 for last null only used for logs
-                            
-                            req = (char*) force_alloc(content_len_n);
-                            if (!req) {
-                                action_network->is_running = false;
-                                action_network = action_network->next;
-                                ERROR("DRAM");
-                                continue;
-                            }
-                            
-                            req[0] = 0;
-                        }
-                        
-                        write_str_ch_values(&str_ch_value_first, &req, action_network->content);
-                    }
-                    
-                    if (action_network->method_n != 4) {
-                        action_network->len--;
-                    }
-                    
+    net_stream_flush(&stream);
+    
+    return stream.result;
+}
+
+// Sends HTTP request through connections pool. If a kept alive connection fails, request is sent once again with a new one
+int net_action_pooled(action_task_t* action_task, action_network_t* action_network, const unsigned int content_len_n, uint8_t rcvtimeout_s, int rcvtimeout_us) {
+    int result = -1;
+    
+    for (unsigned int attempt = 0; attempt < 2; attempt++) {
+        bool reused;
+        net_con_t* net_con = net_con_get(action_network->host, action_network->port_n, rcvtimeout_s, rcvtimeout_us, &result, &reused);
+        if (!net_con) {
+            return result;
+        }
+        
+        INFO("<%i> Payload%s", action_task->ch_group->serv_index, reused ? " (kept)" : "");
+        result = net_action_write(action_network, net_con->socket, content_len_n, true);
+        INFO("\n<%i> Payload %i", action_task->ch_group->serv_index, result);
+        
+        if (result < 0) {
+            net_con_close(net_con);
+            
+            if (reused) {
+                continue;
+            }
+            
+            return result;
+        }
+        
+        net_con->pending++;
+        
+        if (action_network->wait_response > 0) {
+            INFO("<%i> Reply", action_task->ch_group->serv_index);
+            net_con_wait(net_con, 0, true);
+        } else if (net_con->pending > NETWORK_CON_PIPELINE_MAX) {
+            net_con_wait(net_con, NETWORK_CON_PIPELINE_MAX, false);
+        }
+        
+        if (net_con->reusable) {
+            net_con->last_used = xTaskGetTickCount();
+        } else {
+            net_con_close(net_con);
+        }
+        
+        break;
+    }
+    
+    return result;
+}
+
+void net_action_run(action_task_t* action_task) {
+    action_network_t* action_network = action_first(action_task->ch_group, action_task->action, ACTION_TYPE_NETWORK);
+    
+    int socket;
+    
+    while (action_network) {
+        if (action_network->action == action_task->action && !action_network->is_running) {
+            action_network->is_running = true;
+            
+            if (xSemaphoreTake(main_config.network_busy_mutex, MS_TO_TICKS(2000)) == pdTRUE) {
+                INFO("<%i> Net %s:%i", action_task->ch_group->serv_index, action_network->host, action_network->port_n);
+                
+                if (action_network->method_n < 10) {
                     uint8_t rcvtimeout_s = 1;
                     int rcvtimeout_us = 0;
                     if (action_network->wait_response > 0) {
@@ -6579,22 +8249,53 @@ void net_action_task(void* pvParameters) {
                         rcvtimeout_us = (action_network->wait_response % 10) * 100000;
                     }
                     
-                    int result = new_net_con(action_network->host,
+                    int result;
+                    if (action_network->method_n == 4) {
+                        result = new_net_con(action_network->host,
                                              action_network->port_n,
                                              false,
-                                             action_network->method_n == 4 ? action_network->raw : (uint8_t*) req,
+                                             action_network->raw,
                                              action_network->len,
                                              &socket,
                                              rcvtimeout_s, rcvtimeout_us);
-                    
-                    if (result >= 0) {
-                        if (action_network->method_n == 4) {
+                        
+                        if (result >= 0) {
                             INFO("<%i> Payload RAW", action_task->ch_group->serv_index);
-                        } else {
-                            INFO("<%i> Payload %i\n%s", action_task->ch_group->serv_index, action_network->len, req);
                         }
                         
-                        if (action_network->wait_response > 0) {
+                    } else if ((action_network->method_n < 3 && !action_network->head) ||
+                               (action_network->method_n > 0 && !action_network->body)) {
+                        socket = -1;
+                        result = -4;
+                        
+                    } else {
+                        // Body values are formatted first, because Content-length goes before body
+                        unsigned int content_len_n = 0;
+                        if (action_network->method_n > 0) {
+                            content_len_n = net_template_format(action_network->body, action_network->body_values);
+                        }
+                        
+                        if (NETWORK_CON_POOL_SIZE > 0 && action_network->method_n < 3) {
+                            // Socket is owned by connections pool, and reply is read there
+                            socket = -1;
+                            result = net_action_pooled(action_task, action_network, content_len_n, rcvtimeout_s, rcvtimeout_us);
+                            
+                        } else {
+                            result = net_con_connect(action_network->host,
+                                                     action_network->port_n,
+                                                     &socket,
+                                                     rcvtimeout_s, rcvtimeout_us);
+                            
+                            if (result >= 0) {
+                                INFO("<%i> Payload", action_task->ch_group->serv_index);
+                                result = net_action_write(action_network, socket, content_len_n, false);
+                                INFO("\n<%i> Payload %i", action_task->ch_group->serv_index, result);
+                            }
+                        }
+                    }
+                    
+                    if (result >= 0) {
+                        if (action_network->wait_response > 0 && socket >= 0) {
                             INFO("<%i> Reply", action_task->ch_group->serv_index);
                             int read_byte;
                             unsigned int total_recv = 0;
@@ -6618,10 +8319,6 @@ void net_action_task(void* pvParameters) {
                         close(socket);
                     }
                     
-                    if (req) {
-                        free(req);
-                    }
-                    
                 } else {
                     uint8_t* wol = NULL;
                     if (action_network->method_n == 12) {
@@ -6640,23 +8337,42 @@ void net_action_task(void* pvParameters) {
                     int result = -1;
                     
                     if (action_network->method_n == 13) {
-                        unsigned int content_len_n = search_str_ch_values(&str_ch_value_first, action_network->content);
-                        
-                        char* req = (char*) force_alloc(content_len_n + 1);
-                        if (!req) {
+                        if (!action_network->body) {
                             action_network->is_running = false;
                             action_network = action_network->next;
+                            xSemaphoreGive(main_config.network_busy_mutex);
                             ERROR("DRAM");
                             continue;
                         }
                         
-                        req[0] = 0;
-                        write_str_ch_values(&str_ch_value_first, &req, action_network->content);
+                        // A datagram is sent at once, so it is rendered fully. Heap is only used if it does not fit in stack buffer
+                        const unsigned int content_len_n = net_template_format(action_network->body, action_network->body_values);
+                        
+                        char buffer[NETWORK_ACTION_STREAM_BUFFER];
+                        net_stream_t stream = {
+                            .socket = -1,
+                            .size = content_len_n + 1,
+                            .buffer = buffer
+                        };
+                        
+                        if (stream.size > NETWORK_ACTION_STREAM_BUFFER) {
+                            stream.buffer = (char*) force_alloc(stream.size);
+                            if (!stream.buffer) {
+                                action_network->is_running = false;
+                                action_network = action_network->next;
+                                xSemaphoreGive(main_config.network_busy_mutex);
+                                ERROR("DRAM");
+                                continue;
+                            }
+                        }
+                        
+                        net_template_write(&stream, action_network->body, action_network->body_values);
+                        stream.buffer[stream.len] = 0;
                         
                         result = new_net_con(action_network->host,
                                              action_network->port_n,
                                              true,
-                                             (uint8_t*) req,
+                                             (uint8_t*) stream.buffer,
                                              content_len_n,
                                              &socket,
                                              1, 0);
@@ -6665,11 +8381,13 @@ void net_action_task(void* pvParameters) {
                             close(socket);
                             
                             if (result > 0) {
-                                INFO("<%i> Payload\n%s", action_task->ch_group->serv_index, req);
+                                INFO("<%i> Payload\n%s", action_task->ch_group->serv_index, stream.buffer);
                             }
                         }
                         
-                        free(req);
+                        if (stream.buffer != buffer) {
+                            free(stream.buffer);
+                        }
                         
                     } else {
                         unsigned int max_attemps = 1;
@@ -6717,22 +8435,17 @@ void net_action_task(void* pvParameters) {
             INFO("<%i> Net done", action_task->ch_group->serv_index);
             
             vTaskDelay(1);
+        } else if (action_network->action != action_task->action && action_task->ch_group->action_table) {
+            break;
         }
         
         action_network = action_network->next;
     }
-
-    free(action_task);
-    vTaskDelete(NULL);
 }
 
-// --- IR/RF Send task
-void irrf_tx_task(void* pvParameters) {
-    vTaskDelay(1);
-    
-    action_task_t* action_task = (action_task_t*) pvParameters;
-    
-    action_irrf_tx_t* action_irrf_tx = action_task->ch_group->action_irrf_tx;
+// --- IR/RF Send job
+void irrf_tx_run(action_task_t* action_task) {
+    action_irrf_tx_t* action_irrf_tx = action_first(action_task->ch_group, action_task->action, ACTION_TYPE_IRRF_TX);
     
     while (action_irrf_tx) {
         if (action_irrf_tx->action == action_task->action) {
@@ -7090,20 +8803,17 @@ void irrf_tx_task(void* pvParameters) {
             if (ir_code) {
                 free(ir_code);
             }
+        } else if (action_task->ch_group->action_table) {
+            break;
         }
         
         action_irrf_tx = action_irrf_tx->next;
     }
-    
-    free(action_task);
-    vTaskDelete(NULL);
 }
 
-// --- UART action task
-void uart_action_task(void* pvParameters) {
-    action_task_t* action_task = (action_task_t*) pvParameters;
-    
-    action_uart_t* action_uart = action_task->ch_group->action_uart;
+// --- UART action job
+void uart_action_run(action_task_t* action_task) {
+    action_uart_t* action_uart = action_first(action_task->ch_group, action_task->action, ACTION_TYPE_UART);
     
     while (action_uart) {
         if (action_uart->action == action_task->action) {
@@ -7127,20 +8837,160 @@ void uart_action_task(void* pvParameters) {
                 INFO_NNL("%02x", action_uart->command[i]);
             }
             INFO("");
+        } else if (action_task->ch_group->action_table) {
+            break;
         }
         
         vTaskDelay(action_uart->pause);
         
         action_uart = action_uart->next;
     }
+}
+
+// --- Action workers
+static const struct {
+    void (*run)(action_task_t* action_task);
+    TickType_t (*idle)();   // Called when worker is idle, returns ticks until next call
+    const char* name;
+    uint16_t task_size;
+    uint8_t task_priority;
+    uint8_t workers;
+    uint8_t action_type;
+} action_worker_types[ACTION_WORKER_TYPES] = {
+    { net_action_run,   net_con_pool_idle,  "NET",  NETWORK_ACTION_TASK_SIZE,   NETWORK_ACTION_TASK_PRIORITY,   NETWORK_ACTION_WORKERS, ACTION_TYPE_NETWORK },
+    { irrf_tx_run,      NULL,               "IR",   IRRF_TX_TASK_SIZE,          IRRF_TX_TASK_PRIORITY,          IRRF_TX_WORKERS,        ACTION_TYPE_IRRF_TX },
+    { uart_action_run,  NULL,               "UAR",  UART_ACTION_TASK_SIZE,      UART_ACTION_TASK_PRIORITY,      UART_ACTION_WORKERS,    ACTION_TYPE_UART },
+};
+
+void action_worker_task(void* pvParameters) {
+    const unsigned int worker_type = (uint32_t) pvParameters;
+    action_worker_t* action_worker = &main_config.action_workers[worker_type];
+    action_task_t action_task;
+    TickType_t idle_wait = portMAX_DELAY;
+    
+    for (;;) {
+        if (xQueueReceive(action_worker->queue, &action_task, idle_wait) == pdTRUE) {
+            const TickType_t wait = xTaskGetTickCount() - action_task.queue_tick;
+            action_worker->wait_total += wait;
+            if (wait > action_worker->wait_max) {
+                action_worker->wait_max = wait;
+            }
+            
+            action_worker_types[worker_type].run(&action_task);
+        }
+        
+        if (action_worker_types[worker_type].idle) {
+            idle_wait = action_worker_types[worker_type].idle();
+        }
+    }
+}
+
+// Only used when workers could not be created
+void action_oneshot_task(void* pvParameters) {
+    vTaskDelay(1);
+    
+    action_task_t* action_task = (action_task_t*) pvParameters;
+    
+    action_worker_types[action_task->worker_type].run(action_task);
     
     free(action_task);
     vTaskDelete(NULL);
 }
 
+void action_worker_send(const unsigned int worker_type, ch_group_t* ch_group, const uint8_t action) {
+    action_worker_t* action_worker = &main_config.action_workers[worker_type];
+    
+    action_task_t action_task = {
+        .action = action,
+        .worker_type = worker_type,
+        .ch_group = ch_group,
+        .queue_tick = xTaskGetTickCount(),
+    };
+    
+    if (action_worker->queue) {
+        if (xQueueSend(action_worker->queue, &action_task, 0) == pdTRUE) {
+            action_worker->jobs++;
+            
+            const unsigned int depth = uxQueueMessagesWaiting(action_worker->queue);
+            if (depth > action_worker->depth_max) {
+                action_worker->depth_max = depth;
+            }
+        } else {
+            action_worker->dropped++;
+            ERROR("%s full", action_worker_types[worker_type].name);
+        }
+        
+        return;
+    }
+    
+    action_task_t* action_task_copy = malloc(sizeof(action_task_t));
+    if (action_task_copy) {
+        *action_task_copy = action_task;
+        if (xTaskCreate(action_oneshot_task, action_worker_types[worker_type].name, action_worker_types[worker_type].task_size, action_task_copy, action_worker_types[worker_type].task_priority, NULL) == pdPASS) {
+            action_worker->jobs++;
+            return;
+        }
+        
+        free(action_task_copy);
+    }
+    
+    action_worker->dropped++;
+    homekit_remove_oldest_client();
+    ERROR("%s", action_worker_types[worker_type].name);
+}
+
+// Workers and queue are only created for action types used by some ch_group
+void action_workers_init() {
+    for (unsigned int worker_type = 0; worker_type < ACTION_WORKER_TYPES; worker_type++) {
+        ch_group_t* ch_group = main_config.ch_groups;
+        while (ch_group && !ACTION_LIST_HEAD(ch_group, action_worker_types[worker_type].action_type)) {
+            ch_group = ch_group->next;
+        }
+        
+        if (!ch_group) {
+            continue;
+        }
+        
+        action_worker_t* action_worker = &main_config.action_workers[worker_type];
+        action_worker->queue = xQueueCreate(ACTION_WORKER_QUEUE_SIZE, sizeof(action_task_t));
+        if (!action_worker->queue) {
+            ERROR("%s queue", action_worker_types[worker_type].name);
+            continue;
+        }
+        
+        unsigned int workers = 0;
+        for (unsigned int i = 0; i < action_worker_types[worker_type].workers; i++) {
+            if (xTaskCreate(action_worker_task, action_worker_types[worker_type].name, action_worker_types[worker_type].task_size, (void*) worker_type, action_worker_types[worker_type].task_priority, NULL) == pdPASS) {
+                workers++;
+            }
+        }
+        
+        if (workers == 0) {
+            vQueueDelete(action_worker->queue);
+            action_worker->queue = NULL;
+            ERROR("%s workers", action_worker_types[worker_type].name);
+            continue;
+        }
+        
+        INFO("%s workers %i", action_worker_types[worker_type].name, workers);
+    }
+}
+
+void action_workers_stats() {
+    for (unsigned int worker_type = 0; worker_type < ACTION_WORKER_TYPES; worker_type++) {
+        action_worker_t* action_worker = &main_config.action_workers[worker_type];
+        if (action_worker->jobs > 0 || action_worker->dropped > 0) {
+            INFO("%s jobs %"HAA_LONGINT_F", drop %"HAA_LONGINT_F", depth %i/%i, max wait %"HAA_LONGINT_F" ms, avg %"HAA_LONGINT_F" ms",
+                 action_worker_types[worker_type].name, action_worker->jobs, action_worker->dropped,
+                 action_worker->queue ? uxQueueMessagesWaiting(action_worker->queue) : 0, action_worker->depth_max,
+                 action_worker->wait_max * portTICK_PERIOD_MS, (action_worker->jobs > 0 ? action_worker->wait_total / action_worker->jobs : 0) * portTICK_PERIOD_MS);
+        }
+    }
+}
+
 // --- ACTIONS
-void autoswitch_timer(TimerHandle_t xTimer) {
-    action_binary_output_t* action_binary_output = (action_binary_output_t*) pvTimerGetTimerID(xTimer);
+void autoswitch(void* args) {
+    action_binary_output_t* action_binary_output = (action_binary_output_t*) args;
     
     if (action_binary_output->trigger_gpio_mode == 0) {
         extended_gpio_write(action_binary_output->gpio, !action_binary_output->value);
@@ -7149,6 +8999,11 @@ void autoswitch_timer(TimerHandle_t xTimer) {
     }
     
     INFO("Auto DigO %i->%i", action_binary_output->gpio, !action_binary_output->value);
+}
+
+// Only used when timer pool is full
+void autoswitch_timer(TimerHandle_t xTimer) {
+    autoswitch(pvTimerGetTimerID(xTimer));
     
     rs_esp_timer_delete(xTimer);
 }
@@ -7156,11 +9011,14 @@ void autoswitch_timer(TimerHandle_t xTimer) {
 void do_actions(ch_group_t* ch_group, uint8_t action) {
     INFO("<%i> Run A%i", ch_group->serv_index, action);
     
+    action_entry_t* action_entry = action_entry_find(ch_group, action);
+    
     // Copy actions
-    action_copy_t* action_copy = ch_group->action_copy;
+    action_copy_t* action_copy = action_entry_first(ch_group, action_entry, ACTION_TYPE_COPY);
     while (action_copy) {
         if (action_copy->action == action) {
             action = action_copy->new_action;
+            action_entry = action_entry_find(ch_group, action);
             action_copy = NULL;
         } else {
             action_copy = action_copy->next;
@@ -7168,7 +9026,7 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
     }
     
     // Binary outputs
-    action_binary_output_t* action_binary_output = ch_group->action_binary_output;
+    action_binary_output_t* action_binary_output = action_entry_first(ch_group, action_entry, ACTION_TYPE_BINARY_OUTPUT);
     while (action_binary_output) {
         if (action_binary_output->action == action) {
             if (action_binary_output->trigger_gpio_mode == 0) {
@@ -7179,16 +9037,19 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
             
             INFO("<%i> DigO %i->%i (%"HAA_LONGINT_F")", ch_group->serv_index, action_binary_output->gpio, action_binary_output->value, action_binary_output->inching);
             
-            if (action_binary_output->inching > 0) {
+            if (action_binary_output->inching > 0 &&
+                rs_timer_pool_arm(action_binary_output->inching, autoswitch, (void*) action_binary_output) == 0) {
                 rs_esp_timer_start(rs_esp_timer_create(action_binary_output->inching, pdFALSE, (void*) action_binary_output, autoswitch_timer));
             }
+        } else if (ch_group->action_table) {
+            break;
         }
         
         action_binary_output = action_binary_output->next;
     }
     
     // Service Notification Manager
-    action_serv_manager_t* action_serv_manager = ch_group->action_serv_manager;
+    action_serv_manager_t* action_serv_manager = action_entry_first(ch_group, action_entry, ACTION_TYPE_SERV_MANAGER);
     ch_group_t* ch_group_ori = ch_group;
     while (action_serv_manager) {
         if (action_serv_manager->action == action) {
@@ -7539,8 +9400,10 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
                                     } else if (!ch_group->is_working) {
                                         ch_group->is_working = true;
                                         FM_OVERRIDE_VALUE = action_serv_manager->value;
+                                        poll_task_add();
                                         if (xTaskCreate(free_monitor_task, "FM", FREE_MONITOR_TASK_SIZE, (void*) ch_group, FREE_MONITOR_TASK_PRIORITY, NULL) != pdPASS) {
                                             ch_group->is_working = false;
+                                            poll_task_give();
                                             homekit_remove_oldest_client();
                                             ERROR("FM");
                                         }
@@ -7592,13 +9455,15 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
             } else {
                 ERROR("Target");
             }
+        } else if (ch_group_ori->action_table) {
+            break;
         }
 
         action_serv_manager = action_serv_manager->next;
     }
     
     // System Actions
-    action_system_t* action_system = ch_group->action_system;
+    action_system_t* action_system = action_entry_first(ch_group, action_entry, ACTION_TYPE_SYSTEM);
     while (action_system) {
         if (action_system->action == action) {
             INFO("<%i> Sys %i", ch_group->serv_index, action_system->value);
@@ -7628,13 +9493,15 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
                     reboot_haa();
                     break;
             }
+        } else if (ch_group->action_table) {
+            break;
         }
         
         action_system = action_system->next;
     }
     
     // PWM actions
-    action_pwm_t* action_pwm = ch_group->action_pwm;
+    action_pwm_t* action_pwm = action_entry_first(ch_group, action_entry, ACTION_TYPE_PWM);
     while (action_pwm) {
         if (action_pwm->action == action) {
             INFO("<%i> PWM %i->%i, f %i, d %i", ch_group->serv_index, action_pwm->gpio, action_pwm->duty, action_pwm->freq, action_pwm->dithering);
@@ -7661,13 +9528,15 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
                 adv_pwm_set_freq(action_pwm->freq);
 #endif
             }
+        } else if (ch_group->action_table) {
+            break;
         }
         
         action_pwm = action_pwm->next;
     }
     
     // Set Characteristic actions
-    action_set_ch_t* action_set_ch = ch_group->action_set_ch;
+    action_set_ch_t* action_set_ch = action_entry_first(ch_group, action_entry, ACTION_TYPE_SET_CH);
     while (action_set_ch) {
         if (action_set_ch->action == action) {
             INFO("<%i> SetCh %g.%i->%i.%i", ch_group->serv_index, action_set_ch->source_serv, action_set_ch->source_ch, action_set_ch->target_serv, action_set_ch->target_ch);
@@ -7679,31 +9548,19 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
             }
             
             set_hkch_value(ch_group_find_by_serv(action_set_ch->target_serv)->ch[action_set_ch->target_ch], value);
+        } else if (ch_group->action_table) {
+            break;
         }
         
         action_set_ch = action_set_ch->next;
     }
     
-    action_task_t* create_action_task() {
-        action_task_t* action_task = calloc(1, sizeof(action_task_t));
-        action_task->action = action;
-        action_task->ch_group = ch_group;
-        
-        return action_task;
-    }
-    
     // UART actions
     if (ch_group->action_uart) {
-        action_uart_t* action_uart = ch_group->action_uart;
+        action_uart_t* action_uart = action_entry_first(ch_group, action_entry, ACTION_TYPE_UART);
         while (action_uart) {
             if (action_uart->action == action) {
-                action_task_t* action_task = create_action_task();
-                if (xTaskCreate(uart_action_task, "UAR", UART_ACTION_TASK_SIZE, action_task, UART_ACTION_TASK_PRIORITY, NULL) != pdPASS) {
-                    free(action_task);
-                    homekit_remove_oldest_client();
-                    ERROR("UAR");
-                }
-                
+                action_worker_send(ACTION_WORKER_UART, ch_group, action);
                 break;
             }
             
@@ -7713,16 +9570,10 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
     
     // Network actions
     if (ch_group->action_network && main_config.wifi_status == WIFI_STATUS_CONNECTED) {
-        action_network_t* action_network = ch_group->action_network;
+        action_network_t* action_network = action_entry_first(ch_group, action_entry, ACTION_TYPE_NETWORK);
         while (action_network) {
             if (action_network->action == action) {
-                action_task_t* action_task = create_action_task();
-                if (xTaskCreate(net_action_task, "NET", NETWORK_ACTION_TASK_SIZE, action_task, NETWORK_ACTION_TASK_PRIORITY, NULL) != pdPASS) {
-                    free(action_task);
-                    homekit_remove_oldest_client();
-                    ERROR("NET");
-                }
-                
+                action_worker_send(ACTION_WORKER_NETWORK, ch_group, action);
                 break;
             }
             
@@ -7732,16 +9583,10 @@ void do_actions(ch_group_t* ch_group, uint8_t action) {
     
     // IRRF TX actions
     if (ch_group->action_irrf_tx) {
-        action_irrf_tx_t* action_irrf_tx = ch_group->action_irrf_tx;
+        action_irrf_tx_t* action_irrf_tx = action_entry_first(ch_group, action_entry, ACTION_TYPE_IRRF_TX);
         while (action_irrf_tx) {
             if (action_irrf_tx->action == action) {
-                action_task_t* action_task = create_action_task();
-                if (xTaskCreate(irrf_tx_task, "IR", IRRF_TX_TASK_SIZE, action_task, IRRF_TX_TASK_PRIORITY, NULL) != pdPASS) {
-                    free(action_task);
-                    homekit_remove_oldest_client();
-                    ERROR("IR");
-                }
-                
+                action_worker_send(ACTION_WORKER_IRRF_TX, ch_group, action);
                 break;
             }
             
@@ -7897,7 +9742,7 @@ void run_homekit_server() {
     rs_esp_timer_start_forced(wifi_watchdog_timer);
     
     if (main_config.ping_inputs) {
-        rs_esp_timer_start_forced(rs_esp_timer_create(main_config.ping_poll_period * 1000.f, pdTRUE, NULL, ping_task_timer_worker));
+        poll_timer_start(poll_timer_create(main_config.ping_poll_period * 1000.f, NULL, ping_task_timer_worker));
     }
 }
 
@@ -7943,19 +9788,121 @@ void homekit_re_pair_timer(TimerHandle_t xTimer) {
     rs_esp_timer_delete(xTimer);
 }
 
+#ifdef CONFIG_CACHE
+// Config cache: script compiled with cJSON_rsf_Compile and stored next to it, so
+// boot loads it without parsing JSON text.
+//
+// Header:  script length (4), script CRC32 (4)
+// Payload: cJSON_rsf compiled tree. Empty when it would leave less than
+//          CONFIG_CACHE_MIN_FREE_SIZE free in sysparam, so that script is not
+//          compiled again at every boot.
+
+void config_cache_save(cJSON_rsf* json_haa, const uint8_t* header) {
+    size_t compiled_len = cJSON_rsf_Compile(json_haa, NULL, 0);
+    
+#ifndef ESP_PLATFORM
+    // Stale cache space is free too. Key and value entries have a 4 bytes header
+    sysparam_erase(CONFIG_CACHE_SYSPARAM);
+    
+    size_t free_space = 0;
+    if (sysparam_get_free(&free_space) != SYSPARAM_OK
+        || free_space < 4 + strlen(CONFIG_CACHE_SYSPARAM) + 4 + CONFIG_CACHE_HEADER_SIZE + compiled_len + CONFIG_CACHE_MIN_FREE_SIZE) {
+        compiled_len = 0;
+    }
+#endif
+    
+    uint8_t* cache = malloc(CONFIG_CACHE_HEADER_SIZE + compiled_len);
+    if (!cache) {
+        return;
+    }
+    
+    memcpy(cache, header, CONFIG_CACHE_HEADER_SIZE);
+    size_t len = CONFIG_CACHE_HEADER_SIZE;
+    if (compiled_len > 0 && cJSON_rsf_Compile(json_haa, cache + CONFIG_CACHE_HEADER_SIZE, compiled_len) == compiled_len) {
+        len += compiled_len;
+    }
+    
+    if (len == CONFIG_CACHE_HEADER_SIZE || sysparam_set_blob(CONFIG_CACHE_SYSPARAM, cache, len) != SYSPARAM_OK) {
+        sysparam_set_blob(CONFIG_CACHE_SYSPARAM, cache, CONFIG_CACHE_HEADER_SIZE);
+        len = CONFIG_CACHE_HEADER_SIZE;
+    }
+    
+    free(cache);
+    
+    INFO("Config cache %i bytes", len - CONFIG_CACHE_HEADER_SIZE);
+}
+
+cJSON_rsf* config_cache_parse(char** txt_config) {
+    if (!*txt_config) {
+        return NULL;
+    }
+    
+    uint8_t header[CONFIG_CACHE_HEADER_SIZE];
+    const uint32_t script_len = strlen(*txt_config);
+    const uint32_t script_crc = haa_crc32((const uint8_t*) *txt_config, script_len);
+    memcpy(header, &script_len, sizeof(uint32_t));
+    memcpy(header + 4, &script_crc, sizeof(uint32_t));
+    
+    cJSON_rsf* json_haa = NULL;
+    bool cache_valid = false;
+    
+    uint8_t* cache = NULL;
+    size_t cache_len = 0;
+    if (sysparam_get_blob(CONFIG_CACHE_SYSPARAM, &cache, &cache_len) == SYSPARAM_OK) {
+        if (cache_len >= CONFIG_CACHE_HEADER_SIZE && memcmp(cache, header, CONFIG_CACHE_HEADER_SIZE) == 0) {
+            if (cache_len == CONFIG_CACHE_HEADER_SIZE) {
+                cache_valid = true;
+            } else {
+                json_haa = cJSON_rsf_LoadCompiled(cache + CONFIG_CACHE_HEADER_SIZE, cache_len - CONFIG_CACHE_HEADER_SIZE);
+                cache_valid = (json_haa != NULL);
+            }
+        }
+        
+        free(cache);
+    }
+    
+    if (json_haa) {
+        INFO("Config cache");
+        
+        // Script text is not needed by a loaded tree
+        free(*txt_config);
+        *txt_config = NULL;
+        
+        return json_haa;
+    }
+    
+    json_haa = cJSON_rsf_ParseInSitu(*txt_config);
+    
+    if (json_haa && !cache_valid) {
+        config_cache_save(json_haa, header);
+    }
+    
+    return json_haa;
+}
+#endif
+
 void normal_mode_init() {
     main_config.network_busy_mutex = xSemaphoreCreateMutex();
+    rs_timer_wheel_init(POLL_TIMER_RESOLUTION_MS);
+    main_config.poll_scheduler.epoch = xTaskGetTickCount();
     
-    unistring_t* unistrings = NULL;
+    unistrings_t unistrings;
     
     char* txt_config = NULL;
     sysparam_get_string(HAA_SCRIPT_SYSPARAM, &txt_config);
     
-    cJSON_rsf* json_haa = cJSON_rsf_Parse(txt_config);
+#ifdef CONFIG_CACHE
+    cJSON_rsf* json_haa = config_cache_parse(&txt_config);
+#else
+    cJSON_rsf* json_haa = cJSON_rsf_ParseInSitu(txt_config);
+#endif
+    
+    unistring_init(&unistrings, json_count_strings(json_haa));
     
     cJSON_rsf* json_accessories = cJSON_rsf_GetObjectItemCaseSensitive(json_haa, ACCESSORIES_ARRAY);
     
     const unsigned int total_accessories = cJSON_rsf_GetArraySize(json_accessories);
+    cJSON_rsf_Cursor json_accessories_cursor = { 0 };
     
     if (total_accessories == 0) {
         sysparam_set_int32(TOTAL_SERV_SYSPARAM, 0);
@@ -7967,24 +9914,36 @@ void normal_mode_init() {
     
     cJSON_rsf* json_config = cJSON_rsf_GetObjectItemCaseSensitive(json_haa, GENERAL_CONFIG);
     
+#ifdef LAST_STATES_SNAPSHOT
+    last_states_snapshot_load();
+#endif
+    
     // Binary Inputs GPIO Setup function
     bool diginput_register(cJSON_rsf* json_buttons, void* callback, ch_group_t* ch_group, const uint8_t param) {
         unsigned int active = false;
         
-        for (unsigned int j = 0; j < cJSON_rsf_GetArraySize(json_buttons); j++) {
+        cJSON_rsf* json_button;
+        cJSON_rsf_ArrayForEach(json_button, json_buttons) {
             int button_data[2] = { 0, 1 };
             
-            cJSON_rsf* json_button = cJSON_rsf_GetArrayItem(json_buttons, j);
-            
-            if (cJSON_rsf_GetObjectItemCaseSensitive(json_button, PIN_GPIO) == NULL) {
-                for (unsigned int k = 0; k < cJSON_rsf_GetArraySize(json_button); k++) {
-                    button_data[k] = (uint16_t) cJSON_rsf_GetArrayItem(json_button, k)->valuefloat;
+            cJSON_rsf* json_pin_gpio = cJSON_rsf_GetObjectItemCaseSensitive(json_button, PIN_GPIO);
+            if (json_pin_gpio == NULL) {
+                unsigned int k = 0;
+                cJSON_rsf* json_button_data;
+                cJSON_rsf_ArrayForEach(json_button_data, json_button) {
+                    if (k == 2) {
+                        break;
+                    }
+                    
+                    button_data[k] = (uint16_t) json_button_data->valuefloat;
+                    k++;
                 }
             } else {    // OLD WAY
-                button_data[0] = (uint16_t) cJSON_rsf_GetObjectItemCaseSensitive(json_button, PIN_GPIO)->valuefloat;
+                button_data[0] = (uint16_t) json_pin_gpio->valuefloat;
                 
-                if (cJSON_rsf_GetObjectItemCaseSensitive(json_button, BUTTON_PRESS_TYPE) != NULL) {
-                    button_data[1] = (uint8_t) cJSON_rsf_GetObjectItemCaseSensitive(json_button, BUTTON_PRESS_TYPE)->valuefloat;
+                cJSON_rsf* json_press_type = cJSON_rsf_GetObjectItemCaseSensitive(json_button, BUTTON_PRESS_TYPE);
+                if (json_press_type != NULL) {
+                    button_data[1] = (uint8_t) json_press_type->valuefloat;
                 }
             }
             
@@ -8002,33 +9961,38 @@ void normal_mode_init() {
     
     // Ping Setup function
     void ping_register(cJSON_rsf* json_pings, void* callback, ch_group_t* ch_group, const uint8_t param) {
-        for (unsigned int j = 0; j < cJSON_rsf_GetArraySize(json_pings); j++) {
-            ping_input_t* ping_input = ping_input_find_by_host(cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_HOST)->valuestring);
+        cJSON_rsf* json_ping;
+        cJSON_rsf_ArrayForEach(json_ping, json_pings) {
+            const char* ping_host = cJSON_rsf_GetObjectItemCaseSensitive(json_ping, PING_HOST)->valuestring;
+            ping_input_t* ping_input = ping_input_find_by_host(ping_host);
             
             if (!ping_input) {
                 ping_input = calloc(1, sizeof(ping_input_t));
                 
-                ping_input->host = uni_strdup(cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_HOST)->valuestring, &unistrings);
+                ping_input->host = uni_strdup(ping_host, &unistrings);
                 
                 ping_input->next = main_config.ping_inputs;
                 main_config.ping_inputs = ping_input;
             }
             
             unsigned int response_type = true;
-            if (cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_RESPONSE_TYPE) != NULL) {
-                response_type = (bool) cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_RESPONSE_TYPE)->valuefloat;
+            cJSON_rsf* json_response_type = cJSON_rsf_GetObjectItemCaseSensitive(json_ping, PING_RESPONSE_TYPE);
+            if (json_response_type != NULL) {
+                response_type = (bool) json_response_type->valuefloat;
             }
             
             ping_input->ignore_last_response = false;
-            if (cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_IGNORE_LAST_RESPONSE) != NULL) {
-                ping_input->ignore_last_response = (bool) cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_IGNORE_LAST_RESPONSE)->valuefloat;
+            cJSON_rsf* json_ignore_last_response = cJSON_rsf_GetObjectItemCaseSensitive(json_ping, PING_IGNORE_LAST_RESPONSE);
+            if (json_ignore_last_response != NULL) {
+                ping_input->ignore_last_response = (bool) json_ignore_last_response->valuefloat;
             }
             
             ping_input_callback_fn_t* ping_input_callback_fn;
             ping_input_callback_fn = calloc(1, sizeof(ping_input_callback_fn_t));
             
-            if (cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_DISABLE_WITHOUT_WIFI) != NULL) {
-                ping_input_callback_fn->disable_without_wifi = (bool) cJSON_rsf_GetObjectItemCaseSensitive(cJSON_rsf_GetArrayItem(json_pings, j), PING_DISABLE_WITHOUT_WIFI)->valuefloat;
+            cJSON_rsf* json_disable_without_wifi = cJSON_rsf_GetObjectItemCaseSensitive(json_ping, PING_DISABLE_WITHOUT_WIFI);
+            if (json_disable_without_wifi != NULL) {
+                ping_input_callback_fn->disable_without_wifi = (bool) json_disable_without_wifi->valuefloat;
             }
             
             ping_input_callback_fn->callback = callback;
@@ -8090,7 +10054,7 @@ void normal_mode_init() {
                 
                 switch (ch_type) {
                     case CH_TYPE_INT8:
-                        status = sysparam_get_int8(saved_state_id, &saved_state_int8);
+                        status = last_state_get_int8(int_saved_state_id, saved_state_id, &saved_state_int8);
                         
                         if (status == SYSPARAM_OK) {
                             state = saved_state_int8;
@@ -8098,7 +10062,7 @@ void normal_mode_init() {
                         break;
                         
                     case CH_TYPE_INT:
-                        status = sysparam_get_int32(saved_state_id, &saved_state_int);
+                        status = last_state_get_int32(int_saved_state_id, ch_type, saved_state_id, &saved_state_int);
                         
                         if (status == SYSPARAM_OK) {
                             state = saved_state_int;
@@ -8106,7 +10070,7 @@ void normal_mode_init() {
                         break;
                         
                     case CH_TYPE_FLOAT:
-                        status = sysparam_get_int32(saved_state_id, &saved_state_int);
+                        status = last_state_get_int32(int_saved_state_id, ch_type, saved_state_id, &saved_state_int);
                         
                         if (status == SYSPARAM_OK) {
                             state = saved_state_int / FLOAT_FACTOR_SAVE_AS_INT;
@@ -8114,7 +10078,7 @@ void normal_mode_init() {
                         break;
                         
                     case CH_TYPE_STRING:
-                        status = sysparam_get_string(saved_state_id, string_pointer);
+                        status = last_state_get_string(int_saved_state_id, saved_state_id, string_pointer);
                         
                         if (status == SYSPARAM_OK) {
                             state = 1;
@@ -8122,7 +10086,7 @@ void normal_mode_init() {
                         break;
                         
                     default:    // case CH_TYPE_BOOL
-                        status = sysparam_get_bool(saved_state_id, &saved_state_bool);
+                        status = last_state_get_bool(int_saved_state_id, ch_type, saved_state_id, &saved_state_bool);
                         
                         if (status == SYSPARAM_OK) {
                             if (initial_state == INIT_STATE_LAST) {
@@ -8895,7 +10859,7 @@ void normal_mode_init() {
     }
     
     void th_sensor_starter(ch_group_t* ch_group, float poll_period) {
-        ch_group->timer = rs_esp_timer_create(poll_period * 1000, pdTRUE, (void*) ch_group, temperature_timer_worker);
+        ch_group->poll_timer = poll_timer_create(poll_period * 1000, (void*) ch_group, temperature_timer_worker);
     }
     
     int virtual_stop(cJSON_rsf* json_accessory) {
@@ -9102,28 +11066,10 @@ void normal_mode_init() {
         printf_header();
         //INFO("%s\n", txt_config);
         
-        char* txt_config_buffer = malloc(256);
-        
-        for (unsigned int i = 0; i < strlen(txt_config); i += 255) {
-            for (unsigned int j = 0; j < 255; j++) {
-                txt_config_buffer[j] = txt_config[i + j];
-                
-                if (txt_config_buffer[j] == 0) {
-                    break;
-                }
-            }
-            
-            txt_config_buffer[255] = 0;
-            INFO("%s", txt_config_buffer);
-        }
-        
-        free(txt_config_buffer);
-        
-        INFO("");
+        // Script is not printed: txt_config was unescaped in place by parser, and printing it again
+        // from JSON tree would need a second copy of it in heap
     }
     
-    free(txt_config);
-    
     // I2C Bus
     if (cJSON_rsf_GetObjectItemCaseSensitive(json_config, I2C_CONFIG_ARRAY) != NULL) {
         cJSON_rsf* json_i2cs = cJSON_rsf_GetObjectItemCaseSensitive(json_config, I2C_CONFIG_ARRAY);
@@ -9890,8 +11836,8 @@ void normal_mode_init() {
         
         if (cJSON_rsf_GetObjectItemCaseSensitive(json_accessory, EXTRA_SERVICES_ARRAY) != NULL) {
             cJSON_rsf* json_extra_services = cJSON_rsf_GetObjectItemCaseSensitive(json_accessory, EXTRA_SERVICES_ARRAY);
-            for (unsigned int i = 0; i < cJSON_rsf_GetArraySize(json_extra_services); i++) {
-                cJSON_rsf* json_extra_service = cJSON_rsf_GetArrayItem(json_extra_services, i);
+            cJSON_rsf* json_extra_service;
+            cJSON_rsf_ArrayForEach(json_extra_service, json_extra_services) {
                 total_services += get_service_recount(get_serv_type(json_extra_service), json_extra_service);
             }
         }
@@ -9903,7 +11849,7 @@ void normal_mode_init() {
     unsigned int bridge_needed = false;
     
     for (unsigned int i = 0; i < total_accessories; i++) {
-        cJSON_rsf* json_accessory = cJSON_rsf_GetArrayItem(json_accessories, i);
+        cJSON_rsf* json_accessory = cJSON_rsf_GetArrayItemCursor(json_accessories, i, &json_accessories_cursor);
         if (acc_homekit_enabled(json_accessory) && get_serv_type(json_accessory) != SERV_TYPE_IAIRZONING) {
             hk_total_ac += 1;
         }
@@ -12212,9 +14158,9 @@ void normal_mode_init() {
                     LIGHT_SENSOR_POW = cJSON_rsf_GetObjectItemCaseSensitive(json_context, LIGHT_SENSOR_POW_SET)->valuefloat;
                 }
                 
-    #ifdef ESP_PLATFORM
+#ifdef ESP_PLATFORM
                 LIGHT_SENSOR_GPIO = cJSON_rsf_GetObjectItemCaseSensitive(json_context, LIGHT_SENSOR_GPIO_SET)->valuefloat;
-    #endif
+#endif
             } else if (light_sensor_type == 2) {
                 cJSON_rsf* data_array = cJSON_rsf_GetObjectItemCaseSensitive(json_context, LIGHT_SENSOR_I2C_DATA_ARRAY_SET);
                 LIGHT_SENSOR_I2C_BUS = cJSON_rsf_GetArrayItem(data_array, 0)->valuefloat;
@@ -12225,7 +14171,7 @@ void normal_mode_init() {
             }
             
             const float poll_period = sensor_poll_period(json_context, LIGHT_SENSOR_POLL_PERIOD_DEFAULT);
-            rs_esp_timer_start_forced(rs_esp_timer_create(poll_period * 1000, pdTRUE, (void*) ch_group, light_sensor_timer_worker));
+            poll_timer_start(poll_timer_create(poll_period * 1000, (void*) ch_group, light_sensor_timer_worker));
         }
         
         set_killswitch(ch_group, json_context);
@@ -12785,7 +14731,7 @@ void normal_mode_init() {
         
         if (pm_sensor_type <= 4) {
             PM_POLL_PERIOD = sensor_poll_period(json_context, PM_POLL_PERIOD_DEFAULT);
-            rs_esp_timer_start_forced(rs_esp_timer_create(PM_POLL_PERIOD * 1000, pdTRUE, (void*) ch_group, power_monitor_timer_worker));
+            poll_timer_start(poll_timer_create(PM_POLL_PERIOD * 1000, (void*) ch_group, power_monitor_timer_worker));
         }
         
         set_killswitch(ch_group, json_context);
@@ -13109,7 +15055,7 @@ void normal_mode_init() {
             fm_sensor_type < FM_SENSOR_TYPE_UART) {
             const float poll_period = sensor_poll_period(json_context, FM_POLL_PERIOD_DEFAULT);
             if (poll_period > 0) {
-                rs_esp_timer_start_forced(rs_esp_timer_create(poll_period * 1000, pdTRUE, (void*) ch_group, free_monitor_timer_worker));
+                poll_timer_start(poll_timer_create(poll_period * 1000, (void*) ch_group, free_monitor_timer_worker));
             }
         }
         
@@ -13124,7 +15070,14 @@ void normal_mode_init() {
         const unsigned int hist_ch = cJSON_rsf_GetArrayItem(data_array, 1)->valuefloat;
         const unsigned int hist_size = cJSON_rsf_GetArrayItem(data_array, 2)->valuefloat;
         
-        INFO("Serv %i, Ch %i, Size %i", hist_service, hist_ch, hist_size * HIST_REGISTERS_BY_BLOCK);
+        bool hist_compressed = false;
+        if (cJSON_rsf_GetObjectItemCaseSensitive(json_context, HIST_COMPRESSED_SET) != NULL) {
+            hist_compressed = (bool) cJSON_rsf_GetObjectItemCaseSensitive(json_context, HIST_COMPRESSED_SET)->valuefloat;
+        }
+        
+        const unsigned int hist_block_size = hist_compressed ? HIST_COMPRESSED_BLOCK_SIZE : HIST_BLOCK_SIZE;
+        
+        INFO("Serv %i, Ch %i, Size %i%s", hist_service, hist_ch, hist_compressed ? hist_size * hist_block_size : hist_size * HIST_REGISTERS_BY_BLOCK, hist_compressed ? "B" : "");
         
         ch_group_t* ch_group = new_ch_group(hist_size, 1, 2, 0);
         ch_group->serv_type = SERV_TYPE_DATA_HISTORY;
@@ -13156,7 +15109,7 @@ void normal_mode_init() {
         //service_iid += (hist_size + 1);
         
         for (unsigned int i = 0; i < hist_size; i++) {
-            // Each block uses 132 + HIST_BLOCK_SIZE bytes
+            // Each block uses 132 + hist_block_size bytes
             ch_group->ch[i] = NEW_HOMEKIT_CHARACTERISTIC(CUSTOM_DATA_HISTORY, NULL, 0);
             char index[4];
             itoa(i, index, 10);
@@ -13168,7 +15121,7 @@ void normal_mode_init() {
                 memcpy((char*) (ch_group->ch[i]->type + 5), index, 3);
             }
             
-            ch_group->ch[i]->value.data_value = calloc(1, HIST_BLOCK_SIZE);
+            ch_group->ch[i]->value.data_value = calloc(1, hist_block_size);
             
             ch_group->ch[i]->value.data_size = 8;
             accessories[accessory]->services[service]->characteristics[i] = ch_group->ch[i];
@@ -13176,9 +15129,53 @@ void normal_mode_init() {
         
         HIST_LAST_REGISTER = hist_size * HIST_BLOCK_SIZE;
         
+        data_history_t* data_history = NULL;
+        
+        if (cJSON_rsf_GetObjectItemCaseSensitive(json_context, HIST_FLASH_SET) != NULL || hist_compressed) {
+            data_history = calloc(1, sizeof(data_history_t));
+            data_history->ch_group = ch_group;
+            data_history->compressed = hist_compressed;
+            data_history->next = main_config.data_histories;
+            main_config.data_histories = data_history;
+        }
+        
+        cJSON_rsf* json_hist_flash = cJSON_rsf_GetObjectItemCaseSensitive(json_context, HIST_FLASH_SET);
+        if (json_hist_flash) {
+            uint32_t first_sector = 0;
+            uint16_t sectors = 0;
+            if (cJSON_rsf_IsArray(json_hist_flash) &&
+                cJSON_rsf_GetArraySize(json_hist_flash) == 2 &&
+                cJSON_rsf_IsNumber(cJSON_rsf_GetArrayItem(json_hist_flash, 0)) &&
+                cJSON_rsf_IsNumber(cJSON_rsf_GetArrayItem(json_hist_flash, 1)) &&
+                cJSON_rsf_GetArrayItem(json_hist_flash, 0)->valuefloat >= 0 &&
+                cJSON_rsf_GetArrayItem(json_hist_flash, 0)->valuefloat <= UINT16_MAX &&
+                cJSON_rsf_GetArrayItem(json_hist_flash, 1)->valuefloat >= 0 &&
+                cJSON_rsf_GetArrayItem(json_hist_flash, 1)->valuefloat <= UINT16_MAX) {
+                first_sector = cJSON_rsf_GetArrayItem(json_hist_flash, 0)->valuefloat;
+                sectors = cJSON_rsf_GetArrayItem(json_hist_flash, 1)->valuefloat;
+            }
+            
+            hist_flash_t* hist_flash = NULL;
+#ifndef ESP_PLATFORM
+            if (first_sector >= HIST_FLASH_MIN_SECTOR)
+#endif
+            {
+                hist_flash = hist_flash_new(first_sector, sectors);
+            }
+            
+            if (hist_flash) {
+                data_history->hist_flash = hist_flash;
+                
+                INFO("Flash %i, %i", first_sector, sectors);
+                INFO("Restored %i", hist_flash_read(hist_flash, data_history_flash_read_callback, (void*) data_history));
+            } else {
+                ERROR("Flash %i, %i", first_sector, sectors);
+            }
+        }
+        
         const float poll_period = sensor_poll_period(json_context, 0);
         if (poll_period > 0.f) {
-            rs_esp_timer_start_forced(rs_esp_timer_create(poll_period * 1000, pdTRUE, (void*) ch_group, data_history_timer_worker));
+            poll_timer_start(poll_timer_create(poll_period * 1000, (void*) ch_group, data_history_timer_worker));
         }
         
         set_killswitch(ch_group, json_context);
@@ -13298,7 +15295,7 @@ void normal_mode_init() {
     for (unsigned int i = 0; i < total_accessories; i++) {
         INFO("\n** ACC %i", i + 1);
         
-        cJSON_rsf* json_accessory = cJSON_rsf_GetArrayItem(json_accessories, i);
+        cJSON_rsf* json_accessory = cJSON_rsf_GetArrayItemCursor(json_accessories, i, &json_accessories_cursor);
         unsigned int serv_type = get_serv_type(json_accessory);
         
         unsigned int service = 0;
@@ -13310,9 +15307,8 @@ void normal_mode_init() {
                 service += get_service_recount(serv_type, json_accessory);
 
                 cJSON_rsf* json_extra_services = cJSON_rsf_GetObjectItemCaseSensitive(json_accessory, EXTRA_SERVICES_ARRAY);
-                for (unsigned int m = 0; m < cJSON_rsf_GetArraySize(json_extra_services); m++) {
-                    cJSON_rsf* json_extra_service = cJSON_rsf_GetArrayItem(json_extra_services, m);
-                    
+                cJSON_rsf* json_extra_service;
+                cJSON_rsf_ArrayForEach(json_extra_service, json_extra_services) {
                     serv_type = get_serv_type(json_extra_service);
                     new_service(acc_count, service, 0, json_extra_service, serv_type);
                     service += get_service_recount(serv_type, json_extra_service);
@@ -13436,9 +15432,53 @@ void normal_mode_init() {
         }
     }
     
+    ch_group_index_build();
+    
+    unsigned int inching_count = 0;
+    ch_group_t* ch_group = main_config.ch_groups;
+    while (ch_group) {
+        action_table_build(ch_group);
+        
+        if ((ch_group->serv_type == SERV_TYPE_FREE_MONITOR ||
+             ch_group->serv_type == SERV_TYPE_FREE_MONITOR_ACCUMULATVE) &&
+            FM_SENSOR_TYPE == FM_SENSOR_TYPE_MATHS) {
+            ch_group->fm_maths = fm_maths_compile(ch_group);
+        }
+        
+        action_network_t* action_network = ch_group->action_network;
+        while (action_network) {
+            net_template_build(ch_group, action_network);
+            action_network = action_network->next;
+        }
+        
+        action_binary_output_t* action_binary_output = ch_group->action_binary_output;
+        while (action_binary_output) {
+            if (action_binary_output->inching > 0) {
+                inching_count++;
+            }
+            action_binary_output = action_binary_output->next;
+        }
+        
+        ch_group = ch_group->next;
+    }
+    
+    action_workers_init();
+    
+    // Poller retries use timer pool too
+    const unsigned int timer_pool_size = inching_count * INCHING_TIMERS_BY_OUTPUT + main_config.poll_scheduler.timers + (main_config.ping_inputs ? 1 : 0);
+    if (timer_pool_size > 0) {
+        rs_timer_pool_init(timer_pool_size);
+    }
+    
     cJSON_rsf_Delete(json_haa);
+    free(txt_config);
+    
+    INFO("UNIString %i, dup %i, saved %i bytes", unistrings.count, unistrings.dup_count, unistrings.saved_bytes);
+    unistring_destroy(&unistrings);
     
-    unistring_destroy(unistrings);
+#ifdef LAST_STATES_SNAPSHOT
+    last_states_snapshot_free();
+#endif
     
     //set_unused_gpios();
     
@@ -13487,21 +15527,21 @@ void normal_mode_init() {
     main_config.wifi_mode = (uint8_t) wifi_mode;
     
     // Delayed TH Sensors
-    void th_sensor_timer_starter(TimerHandle_t xTimer) {
+    void th_sensor_timer_starter(ch_group_t* ch_group) {
         vTaskDelay(MS_TO_TICKS(3200));
         
-        temperature_timer_worker(xTimer);
-        rs_esp_timer_start_forced(xTimer);
+        temperature_timer_worker(ch_group);
+        poll_timer_start(ch_group->poll_timer);
     }
     
     ch_group_t* th_ch_group = main_config.ch_groups;
     while (th_ch_group) {
         if (th_ch_group->serv_type >= SERV_TYPE_THERMOSTAT &&
             th_ch_group->serv_type <= SERV_TYPE_HUMIDIFIER_WITH_TEMP &&
-            th_ch_group->timer) {
+            th_ch_group->poll_timer) {
             INFO("<%i> Start TH", th_ch_group->serv_index);
             
-            th_sensor_timer_starter(th_ch_group->timer);
+            th_sensor_timer_starter(th_ch_group);
         }
         
         th_ch_group = th_ch_group->next;
@@ -13513,11 +15553,13 @@ void normal_mode_init() {
         if (th_ch_group->serv_type == SERV_TYPE_IAIRZONING) {
             INFO("<%i> Start iAZ", th_ch_group->serv_index);
             
-            th_sensor_timer_starter(th_ch_group->timer);
+            th_sensor_timer_starter(th_ch_group);
         }
         
         th_ch_group = th_ch_group->next;
     }
+    
+    poll_scheduler_stats();
         
     random_task_long_delay();
     
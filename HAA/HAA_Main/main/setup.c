@@ -124,6 +124,11 @@ void haa_remove_saved_states() {
             sysparam_erase(saved_state_id);
         }
     }
+    
+#ifdef LAST_STATES_SNAPSHOT
+    sysparam_erase(LAST_STATES_SNAPSHOT_SYSPARAM_A);
+    sysparam_erase(LAST_STATES_SNAPSHOT_SYSPARAM_B);
+#endif
 }
 
 void haa_increase_last_hk_config_number() {
@@ -913,6 +918,10 @@ static void wifi_config_server_on_settings_update_task(void* args) {
             
             haa_remove_saved_states();
             
+#ifdef CONFIG_CACHE
+            sysparam_erase(CONFIG_CACHE_SYSPARAM);
+#endif
+            
             if (conf_param && conf_param->value) {
                 sysparam_set_string(HAA_SCRIPT_SYSPARAM, conf_param->value);
             } else {
@@ -66,6 +66,31 @@ typedef struct _action_system {
     struct _action_system* next;
 } action_system_t;
 
+typedef struct _net_segment {
+    uint16_t len;           // 0 for a characteristic value
+    
+    union {
+        const char* literal;
+        homekit_characteristic_t* ch;   // NULL if wildcard has no valid target
+    };
+} net_segment_t;
+
+typedef struct _net_template {
+    uint16_t count;
+    uint16_t values;        // Segments with a characteristic value
+    
+    net_segment_t segments[];
+} net_template_t;
+
+typedef struct _net_stream {
+    int socket;             // -1 to only render into buffer
+    int result;             // Bytes written, or negative error
+    
+    uint16_t size;
+    uint16_t len;
+    char* buffer;
+} net_stream_t;
+
 typedef struct _action_network {
     uint8_t action;
     
@@ -87,6 +112,10 @@ typedef struct _action_network {
         uint8_t* raw;
     };
     
+    net_template_t* head;   // Built after config load, HTTP request line and headers
+    net_template_t* body;   // Content of text methods
+    char* body_values;      // Body values formatted before sending, Content-length needs them
+    
     struct _action_network* next;
 } action_network_t;
 
@@ -165,6 +194,56 @@ typedef struct _pattern {
     struct _pattern* next;
 } pattern_t;
 
+typedef struct _action_entry {
+    uint8_t action;
+    uint16_t types;         // Bit per ACTION_TYPE_*
+    uint16_t first;         // Index in action_table_t first[] of lowest type
+} action_entry_t;
+
+typedef struct _action_table {
+    uint8_t count;
+    
+    action_entry_t* entries;    // Sorted by action
+    void** first;               // First node of each action run in type lists
+} action_table_t;
+
+typedef struct _fm_maths_window {
+    uint8_t size;
+    uint8_t count;
+    uint8_t head;
+    
+    uint8_t deque_first;    // Min and max only
+    uint8_t deque_count;
+    uint8_t* deque;         // Slots of monotonic candidates
+    
+    float* sorted;          // Median only
+    
+    double mean;            // Avg and stddev only, double to survive large jumps
+    double m2;              // Sum of squared deviations from mean
+    
+    float samples[];
+} fm_maths_window_t;
+
+typedef struct _fm_maths_op {
+    uint8_t operation;
+    int8_t source;          // FM_MATHS_SOURCE_* or FM_MATHS_GET_*
+    
+    union {
+        float constant;
+        const float* float_value;
+        const int* int_value;
+        const bool* bool_value;
+        fm_maths_window_t* window;
+    };
+} fm_maths_op_t;
+
+typedef struct _fm_maths {
+    uint8_t count;
+    bool start_zero;        // 1 bit
+    
+    fm_maths_op_t ops[];
+} fm_maths_t;
+
 typedef struct _ch_group {
     uint16_t serv_index: 11;
     bool main_enabled: 1;
@@ -184,6 +263,8 @@ typedef struct _ch_group {
     
     TimerHandle_t timer;
     TimerHandle_t timer2;
+    rs_wheel_timer_t* poll_timer;   // Only TH sensors
+    fm_maths_t* fm_maths;           // Only FM maths, built after config load
     
     char* ir_protocol;
     
@@ -197,6 +278,8 @@ typedef struct _ch_group {
     action_pwm_t* action_pwm;
     action_set_ch_t* action_set_ch;
     
+    action_table_t* action_table;   // Built after config load
+    
     wildcard_action_t* wildcard_action;
     
     struct _ch_group* next;
@@ -204,10 +287,73 @@ typedef struct _ch_group {
 
 typedef struct _action_task {
     uint8_t action;
+    uint8_t worker_type;
     
     ch_group_t* ch_group;
+    
+    TickType_t queue_tick;
 } action_task_t;
 
+typedef struct _action_worker {
+    QueueHandle_t queue;            // NULL if workers could not be created
+    
+    uint8_t depth_max;
+    uint32_t jobs;
+    uint32_t dropped;
+    TickType_t wait_max;
+    TickType_t wait_total;
+} action_worker_t;
+
+typedef struct _net_con {
+    char* host;                 // NULL if free
+    int socket;
+    uint16_t port_n;
+    
+    uint8_t pending;            // Requests sent whose response is not fully read
+    uint8_t line_len;
+    bool reusable;              // 1 bit
+    bool closing;               // 1 bit, server sent "Connection: close"
+    bool confirmed;             // 1 bit, server has kept connection alive after a response
+    uint16_t status;            // 0 while waiting for status line of next response
+    int32_t content_len;        // -1 if unknown
+    uint32_t body_left;
+    
+    TickType_t last_used;
+    
+    char line[NETWORK_CON_LINE_LEN];
+} net_con_t;
+
+typedef struct _net_dns {
+    char* host;                 // NULL if free
+    uint16_t port_n;
+    socklen_t addr_len;
+    TickType_t time;
+    
+    struct sockaddr_storage addr;
+} net_dns_t;
+
+typedef struct _poll_retry {
+    rs_timer_callback_t callback;
+    void* args;
+    bool pending;           // Retry armed in timer pool
+    
+    struct _poll_retry* next;
+} poll_retry_t;
+
+typedef struct _poll_scheduler {
+    uint8_t slots[POLL_SCHEDULER_SLOTS];    // Pollers firing in each slot of cycle
+    
+    uint8_t tasks;
+    uint8_t tasks_peak;
+    uint16_t timers;
+    uint32_t deferred;
+    uint32_t skipped;
+    
+    TickType_t epoch;
+    
+    poll_retry_t* retries;  // One by poller
+} poll_scheduler_t;
+
 typedef struct _lightbulb_group {
     uint16_t autodimmer: 10;
     uint8_t channels: 3;
@@ -300,11 +446,16 @@ typedef struct _ping_input {
     struct _ping_input* next;
 } ping_input_t;
 
-typedef struct _str_ch_value {
-    char* string;
-
-    struct _str_ch_value* next;
-} str_ch_value_t;
+typedef struct _data_history {
+    uint8_t block;                      // Current compressed block
+    bool compressed: 1;
+    
+    ch_group_t* ch_group;
+    hist_flash_t* hist_flash;
+    hist_block_encoder_t encoder;
+    
+    struct _data_history* next;
+} data_history_t;
 
 typedef struct _mcp23017 {
     uint8_t index;
@@ -405,10 +556,30 @@ typedef struct _main_config {
     
     SemaphoreHandle_t network_busy_mutex;
     
+    action_worker_t action_workers[ACTION_WORKER_TYPES];
+    net_con_t net_cons[NETWORK_CON_POOL_SIZE];
+    net_dns_t net_dns[NETWORK_DNS_CACHE_SIZE];
+    poll_scheduler_t poll_scheduler;
+    
     ch_group_t* ch_groups;
     ping_input_t* ping_inputs;
     lightbulb_group_t* lightbulb_groups;
+    
+    ch_group_t** ch_groups_by_serv;     // Built after config load
+    lightbulb_group_t** lightbulb_groups_by_ch;
+    uint16_t ch_groups_by_serv_size;
+    uint16_t lightbulb_groups_by_ch_size;
+    
     last_state_t* last_states;
+    data_history_t* data_histories;
+    
+#ifdef LAST_STATES_SNAPSHOT
+    uint8_t* last_states_snapshot;      // Only loaded during init
+    uint32_t last_states_snapshot_seq;
+    uint32_t last_states_snapshot_crc;
+    uint16_t last_states_snapshot_len;
+    bool last_states_legacy: 1;
+#endif
     
     mcp23017_t* mcp23017s;
     
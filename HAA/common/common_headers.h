@@ -109,6 +109,9 @@
 #define HOMEKIT_PAIRING_COUNT_SYSPARAM      "pair_count"
 #define TOTAL_SERV_SYSPARAM                 "total_ac"
 #define HAA_SCRIPT_SYSPARAM                 "haa_conf"
+#define CONFIG_CACHE_SYSPARAM               "haa_cbin"      // Compiled HAA_SCRIPT_SYSPARAM
+#define LAST_STATES_SNAPSHOT_SYSPARAM_A     "ls0"
+#define LAST_STATES_SNAPSHOT_SYSPARAM_B     "ls1"
 #define HAA_SETUP_MODE_SYSPARAM             "setup"
 #define LAST_CONFIG_NUMBER_SYSPARAM         "hkcf"
 
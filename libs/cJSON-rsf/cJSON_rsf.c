@@ -68,6 +68,12 @@ static int case_insensitive_strcmp(const unsigned char *string1, const unsigned
     return tolower(*string1) - tolower(*string2);
 }
 
+/* helper function to cast away const */
+static void* cast_away_const(const void* string)
+{
+    return (void*)string;
+}
+
 static unsigned char* cJSON_rsf_strdup(const unsigned char* string)
 {
     size_t length = 0;
@@ -96,13 +102,130 @@ static cJSON_rsf *cJSON_rsf_New_Item()
     return node;
 }
 
+/* Object member index: FNV-1a hash of each key, a 32 bits bloom filter to reject
+ * most missing keys at once, and one hash byte per member to skip strcmp calls. */
+typedef struct _cJSON_rsf_index
+{
+    uint32_t bloom;
+    uint16_t count;
+    cJSON_rsf *members[];
+    /* followed by uint8_t tags[count] */
+} cJSON_rsf_index;
+
+static uint32_t object_index_hash(const char *string)
+{
+    uint32_t hash = 2166136261UL;
+    while (*string)
+    {
+        hash = (hash ^ (unsigned char) *string++) * 16777619UL;
+    }
+
+    return hash;
+}
+
+static void object_index_free(cJSON_rsf * const item)
+{
+    if ((item != NULL) && cJSON_rsf_IsObject(item) && (item->index != NULL))
+    {
+        free(item->index);
+        item->index = NULL;
+    }
+}
+
+static void object_index_free_all(cJSON_rsf *item)
+{
+    while (item != NULL)
+    {
+        object_index_free(item);
+        object_index_free_all(item->child);
+        item = item->next;
+    }
+}
+
+static cJSON_rsf_index *object_index_build(cJSON_rsf * const object)
+{
+    cJSON_rsf *current_element = NULL;
+    cJSON_rsf_index *index = NULL;
+    uint8_t *tags = NULL;
+    size_t count = 0;
+
+    cJSON_rsf_ArrayForEach(current_element, object)
+    {
+        count++;
+    }
+
+    if (count > UINT16_MAX)
+    {
+        return NULL;
+    }
+
+    index = malloc(sizeof(cJSON_rsf_index) + (count * (sizeof(cJSON_rsf*) + sizeof(uint8_t))));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+
+    index->bloom = 0;
+    index->count = (uint16_t) count;
+    tags = (uint8_t*) &index->members[count];
+
+    count = 0;
+    cJSON_rsf_ArrayForEach(current_element, object)
+    {
+        uint32_t hash = 0;
+        if (current_element->string != NULL)
+        {
+            hash = object_index_hash(current_element->string);
+            index->bloom |= 1UL << (hash & 0x1F);
+        }
+
+        index->members[count] = current_element;
+        tags[count] = (uint8_t) (hash >> 24);
+        count++;
+    }
+
+    object->index = index;
+
+    return index;
+}
+
+static cJSON_rsf *object_index_find(const cJSON_rsf_index * const index, const char * const name)
+{
+    const uint8_t *tags = (const uint8_t*) &index->members[index->count];
+    const uint32_t hash = object_index_hash(name);
+    const uint8_t tag = (uint8_t) (hash >> 24);
+
+    if (!(index->bloom & (1UL << (hash & 0x1F))))
+    {
+        return NULL;
+    }
+
+    for (uint16_t i = 0; i < index->count; i++)
+    {
+        if ((tags[i] == tag) && (index->members[i]->string != NULL) && (strcmp(name, index->members[i]->string) == 0))
+        {
+            return index->members[i];
+        }
+    }
+
+    return NULL;
+}
+
 /* Delete a cJSON_rsf structure. */
 void cJSON_rsf_Delete(cJSON_rsf *item)
 {
     cJSON_rsf *next = NULL;
+    if ((item != NULL) && (item->type & cJSON_rsf_IsArena))
+    {
+        /* whole tree lives in an arena starting at root item */
+        object_index_free_all(item);
+        free(item);
+        return;
+    }
     while (item != NULL)
     {
         next = item->next;
+        object_index_free(item);
         if (!(item->type & cJSON_rsf_IsReference) && (item->child != NULL))
         {
             cJSON_rsf_Delete(item->child);
@@ -134,8 +257,61 @@ typedef struct
     size_t length;
     size_t offset;
     size_t depth;   /* How deeply nested (in arrays/objects) is the input at the current offset. */
+    unsigned char *arena;   /* If not NULL, all items and strings are taken from here */
+    size_t arena_size;
+    size_t arena_used;
+    bool insitu;    /* Strings are unescaped over content, which must be writable. Only used with arena */
 } parse_buffer;
 
+#define ARENA_ALIGN(size) (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+static void *parse_alloc(parse_buffer * const input_buffer, const size_t size)
+{
+    void *allocation = NULL;
+
+    if (input_buffer->arena == NULL)
+    {
+        return malloc(size);
+    }
+
+    if (ARENA_ALIGN(size) > (input_buffer->arena_size - input_buffer->arena_used))
+    {
+        return NULL;
+    }
+
+    /* arena is zeroed when allocated */
+    allocation = input_buffer->arena + input_buffer->arena_used;
+    input_buffer->arena_used += ARENA_ALIGN(size);
+
+    return allocation;
+}
+
+static cJSON_rsf *parse_new_item(parse_buffer * const input_buffer)
+{
+    if (input_buffer->arena == NULL)
+    {
+        return cJSON_rsf_New_Item();
+    }
+
+    return parse_alloc(input_buffer, sizeof(cJSON_rsf));
+}
+
+static void parse_free(parse_buffer * const input_buffer, void *allocation)
+{
+    if (input_buffer->arena == NULL)
+    {
+        free(allocation);
+    }
+}
+
+static void parse_delete(parse_buffer * const input_buffer, cJSON_rsf *item)
+{
+    if (input_buffer->arena == NULL)
+    {
+        cJSON_rsf_Delete(item);
+    }
+}
+
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
 #define can_read(buffer, size) ((buffer != NULL) && (((buffer)->offset + size) <= (buffer)->length))
 /* check if the buffer can be accessed at the given index (starting with 0) */
@@ -144,6 +320,96 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
+static const uint64_t powers_of_10[] =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL
+};
+
+static const float float_powers_of_10[] =
+{
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f
+};
+
+/* Exact conversion of 0 <= number < 2^24 using only integer operations */
+static float uint24_to_float(const uint32_t number)
+{
+    uint32_t bits = 0;
+    float result = 0;
+
+    if (number != 0)
+    {
+        const int msb = 31 - __builtin_clz(number);
+        bits = ((uint32_t) (msb + 127) << 23) | ((number << (23 - msb)) & 0x7FFFFF);
+    }
+
+    memcpy(&result, &bits, sizeof(result));
+
+    return result;
+}
+
+/* Fast path for plain decimals with up to 7 digits and no exponent, the usual numbers in configs.
+ * Mantissa and power of 10 are exact floats, so one correctly rounded division gives the same
+ * result as strtof, and integers do not need any float operation. */
+static bool parse_number_fast(cJSON_rsf * const item, parse_buffer * const input_buffer)
+{
+    const unsigned char *number_c_string = buffer_at_offset(input_buffer);
+    uint32_t mantissa = 0;
+    size_t digits = 0;
+    size_t decimals = 0;
+    size_t i = 0;
+    bool negative = false;
+    float number = 0;
+
+    if (can_access_at_index(input_buffer, i) && (number_c_string[i] == '-'))
+    {
+        negative = true;
+        i++;
+    }
+
+    while (can_access_at_index(input_buffer, i) && (number_c_string[i] >= '0') && (number_c_string[i] <= '9'))
+    {
+        mantissa = (mantissa * 10) + (number_c_string[i] - '0');
+        digits++;
+        i++;
+    }
+
+    if (can_access_at_index(input_buffer, i) && (number_c_string[i] == '.'))
+    {
+        i++;
+        while (can_access_at_index(input_buffer, i) && (number_c_string[i] >= '0') && (number_c_string[i] <= '9'))
+        {
+            mantissa = (mantissa * 10) + (number_c_string[i] - '0');
+            digits++;
+            decimals++;
+            i++;
+        }
+
+        if (decimals == 0)
+        {
+            return false;
+        }
+    }
+
+    if ((digits == 0) || (digits > 7) || (negative && (mantissa == 0)) ||
+        (can_access_at_index(input_buffer, i) && ((number_c_string[i] == 'e') || (number_c_string[i] == 'E'))))
+    {
+        return false;
+    }
+
+    number = uint24_to_float(mantissa);
+    if (decimals > 0)
+    {
+        number /= float_powers_of_10[decimals];
+    }
+
+    item->valuefloat = negative ? -number : number;
+    item->type = cJSON_rsf_Number;
+
+    input_buffer->offset += i;
+    return true;
+}
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static bool parse_number(cJSON_rsf * const item, parse_buffer * const input_buffer)
 {
@@ -159,6 +425,11 @@ static bool parse_number(cJSON_rsf * const item, parse_buffer * const input_buff
         return false;
     }
 
+    if (parse_number_fast(item, input_buffer))
+    {
+        return true;
+    }
+
     /* copy the number into a temporary buffer and replace '.' with the decimal point
      * of the current locale (for strtof)
      * This also takes care of '\0' not necessarily being available for marking the end of the input */
@@ -304,6 +575,156 @@ static void update_offset(printbuffer * const buffer)
     buffer->offset += strlen((const char*)buffer_pointer);
 }
 
+int cJSON_rsf_FormatNumber(const float number, char *buffer)
+{
+    uint32_t bits = 0;
+    uint32_t mantissa = 0;
+    int exponent = 0;
+    int shift = 0;
+    uint64_t decimal = 0;
+    size_t decimals = 0;
+    char digits[12];
+    size_t digits_length = 0;
+    size_t length = 0;
+
+    memcpy(&bits, &number, sizeof(bits));
+    exponent = (int) ((bits >> 23) & 0xFF);
+    mantissa = bits & 0x7FFFFF;
+
+    if ((exponent == 0) || (exponent == 0xFF))
+    {
+        if ((bits & 0x7FFFFFFF) != 0 || (bits >> 31))
+        {
+            return 0; /* subnormal, -0, NaN or Infinity */
+        }
+
+        buffer[0] = '0';
+        buffer[1] = '\0';
+        return 1;
+    }
+
+    /* number is mantissa / 2^shift */
+    mantissa |= 0x800000;
+    shift = 150 - exponent;
+
+    if (shift < 0)
+    {
+        return 0; /* 2^24 or bigger */
+    }
+
+    if ((shift < 24) && ((mantissa & ((1UL << shift) - 1)) == 0))
+    {
+        decimal = mantissa >> shift;
+        if (decimal >= powers_of_10[7])
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        uint64_t scaled = 0;
+        uint64_t remainder = 0;
+        uint64_t error = 0;
+
+        if (shift > 62)
+        {
+            return 0;
+        }
+
+        /* 7 significant digits, as printf, and plain notation down to 0.0001 */
+        for (decimals = 0; decimals <= 11; decimals++)
+        {
+            scaled = mantissa * powers_of_10[decimals];
+            if ((scaled >> shift) >= powers_of_10[6])
+            {
+                break;
+            }
+        }
+
+        if (decimals > 11)
+        {
+            return 0;
+        }
+
+        /* round half to even */
+        decimal = scaled >> shift;
+        remainder = scaled & ((1ULL << shift) - 1);
+        if ((remainder > (1ULL << (shift - 1))) || ((remainder == (1ULL << (shift - 1))) && (decimal & 1)))
+        {
+            decimal++;
+        }
+
+        /* check whether the original float can be recovered, else it needs more digits */
+        error = ((decimal << shift) >= scaled) ? (decimal << shift) - scaled : scaled - (decimal << shift);
+        /* gap to previous float is half when mantissa is a power of 2 */
+        error *= (((decimal << shift) < scaled) && (mantissa == 0x800000) && (exponent > 1)) ? 4 : 2;
+        if ((error > powers_of_10[decimals]) || ((error == powers_of_10[decimals]) && (mantissa & 1)))
+        {
+            return 0;
+        }
+
+        if (decimal == powers_of_10[7])
+        {
+            if (decimals == 0)
+            {
+                return 0;
+            }
+
+            decimal = powers_of_10[6];
+            decimals--;
+        }
+
+        if (decimals > 10)
+        {
+            return 0;
+        }
+
+        while ((decimals > 0) && ((decimal % 10) == 0))
+        {
+            decimal /= 10;
+            decimals--;
+        }
+    }
+
+    do
+    {
+        digits[digits_length++] = (char) ('0' + (decimal % 10));
+        decimal /= 10;
+    }
+    while (decimal > 0);
+
+    if (bits >> 31)
+    {
+        buffer[length++] = '-';
+    }
+
+    if (digits_length <= decimals)
+    {
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for (size_t i = digits_length; i < decimals; i++)
+        {
+            buffer[length++] = '0';
+        }
+    }
+
+    while (digits_length > 0)
+    {
+        if (digits_length == decimals)
+        {
+            if ((length == 0) || (buffer[length - 1] != '.'))
+            {
+                buffer[length++] = '.';
+            }
+        }
+        buffer[length++] = digits[--digits_length];
+    }
+
+    buffer[length] = '\0';
+
+    return (int) length;
+}
+
 /* Render the number nicely from the given item into a string. */
 static bool print_number(const cJSON_rsf * const item, printbuffer * const output_buffer)
 {
@@ -321,12 +742,15 @@ static bool print_number(const cJSON_rsf * const item, printbuffer * const outpu
         return false;
     }
 
+    /* Integers and short decimals are written without libc float formatting */
+    length = cJSON_rsf_FormatNumber(d, (char*) number_buffer);
+
     /* This checks for NaN and Infinity */
-    if ((d * 0) != 0)
+    if ((length == 0) && ((d * 0) != 0))
     {
         length = sprintf((char*)number_buffer, "null");
     }
-    else
+    else if (length == 0)
     {
         /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
         //length = sprintf((char*)number_buffer, "%1.15g", d);
@@ -570,12 +994,20 @@ static bool parse_string(cJSON_rsf * const item, parse_buffer * const input_buff
             goto fail; /* string ended unexpectedly */
         }
 
-        /* This is at most how much we need for the output */
-        allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = malloc(allocation_length + sizeof(""));
-        if (output == NULL)
+        if (input_buffer->insitu)
         {
-            goto fail; /* allocation failure */
+            /* unescaped string is never longer than its literal, so write it over itself */
+            output = (unsigned char*) cast_away_const(input_pointer);
+        }
+        else
+        {
+            /* This is at most how much we need for the output */
+            allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
+            output = parse_alloc(input_buffer, allocation_length + sizeof(""));
+            if (output == NULL)
+            {
+                goto fail; /* allocation failure */
+            }
         }
     }
 
@@ -650,7 +1082,7 @@ static bool parse_string(cJSON_rsf * const item, parse_buffer * const input_buff
 fail:
     if (output != NULL)
     {
-        free(output);
+        parse_free(input_buffer, output);
     }
 
     if (input_pointer != NULL)
@@ -837,7 +1269,7 @@ static parse_buffer *skip_utf8_bom(parse_buffer * const buffer)
 /* Parse an object - create a new root, and populate. */
 cJSON_rsf* cJSON_rsf_ParseWithOpts(const char *value, bool require_null_terminated)
 {
-    parse_buffer buffer = { 0, 0, 0, 0 };
+    parse_buffer buffer = { 0 };
     cJSON_rsf *item = NULL;
 
     if (value == NULL)
@@ -885,7 +1317,7 @@ fail:
 /* Default options for cJSON_rsf_Parse */
 cJSON_rsf* cJSON_rsf_Parse(const char *value)
 {
-    parse_buffer buffer = { 0, 0, 0, 0 };
+    parse_buffer buffer = { 0 };
     cJSON_rsf *item = NULL;
 
     if (value == NULL)
@@ -920,6 +1352,97 @@ fail:
     return NULL;
 }
 
+/* Upper bound of arena bytes needed to parse value: one item per value and,
+ * if strings are not parsed in situ, every string as parse_string() allocates it */
+static size_t arena_estimate(const unsigned char *value, const bool insitu)
+{
+    size_t items = 1;
+    size_t strings = 0;
+    size_t string_length = 0;
+    bool in_string = false;
+
+    for (; *value != '\0'; value++)
+    {
+        if (in_string)
+        {
+            if (*value == '\"')
+            {
+                in_string = false;
+                strings += ARENA_ALIGN(string_length + 2);
+            }
+            else
+            {
+                if ((*value == '\\') && (value[1] != '\0'))
+                {
+                    value++;
+                }
+                string_length++;
+            }
+        }
+        else if (*value == '\"')
+        {
+            in_string = true;
+            string_length = 0;
+        }
+        else if ((*value == ',') || (*value == '[') || (*value == '{'))
+        {
+            items++;
+        }
+    }
+
+    if (insitu)
+    {
+        strings = 0;
+    }
+
+    return (items * ARENA_ALIGN(sizeof(cJSON_rsf))) + strings;
+}
+
+static cJSON_rsf* parse_arena(const char *value, const bool insitu)
+{
+    parse_buffer buffer = { 0 };
+    cJSON_rsf *item = NULL;
+
+    if (value == NULL)
+    {
+        return NULL;
+    }
+
+    buffer.content = (const unsigned char*) value;
+    buffer.length = strlen((const char*) value) + sizeof("");
+    buffer.insitu = insitu;
+    buffer.arena_size = arena_estimate(buffer.content, insitu);
+    buffer.arena = calloc(1, buffer.arena_size);
+    if (buffer.arena == NULL)
+    {
+        /* not enough contiguous memory, use one allocation per item */
+        return cJSON_rsf_Parse(value);
+    }
+
+    /* root item must be at arena start, so cJSON_rsf_Delete can free it */
+    item = parse_new_item(&buffer);
+
+    if (!parse_value(item, buffer_skip_whitespace(skip_utf8_bom(&buffer))))
+    {
+        free(buffer.arena);
+        return NULL;
+    }
+
+    item->type |= cJSON_rsf_IsArena;
+
+    return item;
+}
+
+cJSON_rsf* cJSON_rsf_ParseArena(const char *value)
+{
+    return parse_arena(value, false);
+}
+
+cJSON_rsf* cJSON_rsf_ParseInSitu(char *value)
+{
+    return parse_arena(value, true);
+}
+
 #define cjson_min(a, b) ((a < b) ? a : b)
 
 static unsigned char *print(const cJSON_rsf * const item, bool format)
@@ -1193,7 +1716,7 @@ static bool parse_array(cJSON_rsf * const item, parse_buffer * const input_buffe
     do
     {
         /* allocate next item */
-        cJSON_rsf *new_item = cJSON_rsf_New_Item();
+        cJSON_rsf *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1242,7 +1765,7 @@ success:
 fail:
     if (head != NULL)
     {
-        cJSON_rsf_Delete(head);
+        parse_delete(input_buffer, head);
     }
 
     return false;
@@ -1347,7 +1870,7 @@ static bool parse_object(cJSON_rsf * const item, parse_buffer * const input_buff
     do
     {
         /* allocate next item */
-        cJSON_rsf *new_item = cJSON_rsf_New_Item();
+        cJSON_rsf *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1413,7 +1936,7 @@ success:
 fail:
     if (head != NULL)
     {
-        cJSON_rsf_Delete(head);
+        parse_delete(input_buffer, head);
     }
 
     return false;
@@ -1586,6 +2109,41 @@ cJSON_rsf* cJSON_rsf_GetArrayItem(const cJSON_rsf *array, int index)
     return get_array_item(array, (size_t)index);
 }
 
+cJSON_rsf* cJSON_rsf_GetArrayItemCursor(const cJSON_rsf *array, int index, cJSON_rsf_Cursor *cursor)
+{
+    cJSON_rsf *current_child = NULL;
+    int current_index = 0;
+
+    if ((array == NULL) || (index < 0) || (cursor == NULL))
+    {
+        return NULL;
+    }
+
+    if ((cursor->item != NULL) && (cursor->index <= index))
+    {
+        current_child = cursor->item;
+        current_index = cursor->index;
+    }
+    else
+    {
+        current_child = array->child;
+    }
+
+    while ((current_child != NULL) && (current_index < index))
+    {
+        current_index++;
+        current_child = current_child->next;
+    }
+
+    if (current_child != NULL)
+    {
+        cursor->item = current_child;
+        cursor->index = current_index;
+    }
+
+    return current_child;
+}
+
 static cJSON_rsf *get_object_item(const cJSON_rsf * const object, const char * const name, const bool case_sensitive)
 {
     cJSON_rsf *current_element = NULL;
@@ -1595,9 +2153,39 @@ static cJSON_rsf *get_object_item(const cJSON_rsf * const object, const char * c
         return NULL;
     }
 
-    current_element = object->child;
-    if (case_sensitive)
-    {
+    current_element = object->child;
+    if (case_sensitive)
+    {
+#if CJSON_OBJECT_INDEX_MIN_SIZE > 0
+        if (cJSON_rsf_IsObject(object))
+        {
+            size_t position = 0;
+
+            if (object->index != NULL)
+            {
+                return object_index_find(object->index, name);
+            }
+
+            while ((current_element != NULL) &&
+                   (current_element->string == NULL || (strcmp(name, current_element->string) != 0)))
+            {
+                if (++position == CJSON_OBJECT_INDEX_MIN_SIZE)
+                {
+                    /* large object, index it once, as it will be likely queried again */
+                    const cJSON_rsf_index *index = object_index_build((cJSON_rsf*) cast_away_const(object));
+                    if (index != NULL)
+                    {
+                        return object_index_find(index, name);
+                    }
+                }
+
+                current_element = current_element->next;
+            }
+
+            return current_element;
+        }
+#endif
+
         while ((current_element != NULL) &&
                (current_element->string == NULL || (strcmp(name, current_element->string) != 0)))
         {
@@ -1655,6 +2243,11 @@ static cJSON_rsf *create_reference(const cJSON_rsf *item)
 
     memcpy(reference, item, sizeof(cJSON_rsf));
     reference->string = NULL;
+    if (cJSON_rsf_IsObject(reference))
+    {
+        /* index belongs to referenced item */
+        reference->index = NULL;
+    }
     reference->type |= cJSON_rsf_IsReference;
     reference->next = reference->prev = NULL;
     return reference;
@@ -1669,6 +2262,8 @@ static bool add_item_to_array(cJSON_rsf *array, cJSON_rsf *item)
         return false;
     }
 
+    object_index_free(array);
+
     child = array->child;
 
     if (child == NULL)
@@ -1695,12 +2290,6 @@ void cJSON_rsf_AddItemToArray(cJSON_rsf *array, cJSON_rsf *item)
     add_item_to_array(array, item);
 }
 
-/* helper function to cast away const */
-static void* cast_away_const(const void* string)
-{
-    return (void*)string;
-}
-
 static bool add_item_to_object(cJSON_rsf * const object, const char * const string, cJSON_rsf * const item, const bool constant_key)
 {
     char *new_key = NULL;
@@ -1884,6 +2473,8 @@ cJSON_rsf* cJSON_rsf_DetachItemViaPointer(cJSON_rsf *parent, cJSON_rsf * const i
         return NULL;
     }
 
+    object_index_free(parent);
+
     if (item->prev != NULL)
     {
         /* not the first element */
@@ -1963,6 +2554,8 @@ void cJSON_rsf_InsertItemInArray(cJSON_rsf *array, int which, cJSON_rsf *newitem
         return;
     }
 
+    object_index_free(array);
+
     newitem->next = after_inserted;
     newitem->prev = after_inserted->prev;
     after_inserted->prev = newitem;
@@ -1988,6 +2581,8 @@ bool cJSON_rsf_ReplaceItemViaPointer(cJSON_rsf * const parent, cJSON_rsf * const
         return true;
     }
 
+    object_index_free(parent);
+
     replacement->next = item->next;
     replacement->prev = item->prev;
 
@@ -2372,7 +2967,7 @@ cJSON_rsf* cJSON_rsf_Duplicate(const cJSON_rsf *item, bool recurse)
                 goto fail;
             }
         }
-    } else {
+    } else if (!cJSON_rsf_IsObject(item)) {
         newitem->valuefloat = item->valuefloat;
     }
     if (item->string)
@@ -2719,6 +3314,420 @@ bool cJSON_rsf_Compare(const cJSON_rsf * const a, const cJSON_rsf * const b, con
     }
 }
 
+/* Compiled format:
+ * Header: magic (2), version (1), reserved (1), node count (4)
+ * Node:   tag (1), key (NUL terminated, only if tag has COMPILED_HAS_KEY), payload
+ * Payload depends on tag: int8 (1), int16 (2), float (4), string (NUL terminated), child count (2) followed by children */
+#define COMPILED_MAGIC_0        'c'
+#define COMPILED_MAGIC_1        'J'
+#define COMPILED_VERSION        1
+#define COMPILED_HEADER_SIZE    8
+
+#define COMPILED_FALSE          0
+#define COMPILED_TRUE           1
+#define COMPILED_NULL           2
+#define COMPILED_INT8           3
+#define COMPILED_INT16          4
+#define COMPILED_FLOAT          5
+#define COMPILED_STRING         6
+#define COMPILED_RAW            7
+#define COMPILED_ARRAY          8
+#define COMPILED_OBJECT         9
+#define COMPILED_HAS_KEY        0x80
+
+typedef struct
+{
+    unsigned char *buffer;
+    size_t size;
+    size_t offset;
+    uint32_t nodes;
+} compile_buffer;
+
+static void compile_bytes(compile_buffer * const output, const void * const data, const size_t length)
+{
+    if ((output->buffer != NULL) && (output->offset + length <= output->size))
+    {
+        memcpy(output->buffer + output->offset, data, length);
+    }
+
+    output->offset += length;
+}
+
+static void compile_string(compile_buffer * const output, const char * const string)
+{
+    compile_bytes(output, string, strlen(string) + sizeof(""));
+}
+
+static bool compile_item(const cJSON_rsf * const item, compile_buffer * const output, const size_t depth)
+{
+    unsigned char tag = 0;
+    const cJSON_rsf *child = NULL;
+
+    if (depth >= CJSON_NESTING_LIMIT)
+    {
+        return false;
+    }
+
+    switch ((item->type) & 0xFF)
+    {
+        case cJSON_rsf_False:
+            tag = COMPILED_FALSE;
+            break;
+
+        case cJSON_rsf_True:
+            tag = COMPILED_TRUE;
+            break;
+
+        case cJSON_rsf_NULL:
+            tag = COMPILED_NULL;
+            break;
+
+        case cJSON_rsf_Number:
+            if ((item->valuefloat >= INT8_MIN) && (item->valuefloat <= INT8_MAX) && ((float) (int8_t) item->valuefloat == item->valuefloat))
+            {
+                tag = COMPILED_INT8;
+            }
+            else if ((item->valuefloat >= INT16_MIN) && (item->valuefloat <= INT16_MAX) && ((float) (int16_t) item->valuefloat == item->valuefloat))
+            {
+                tag = COMPILED_INT16;
+            }
+            else
+            {
+                tag = COMPILED_FLOAT;
+            }
+            break;
+
+        case cJSON_rsf_String:
+            tag = COMPILED_STRING;
+            break;
+
+        case cJSON_rsf_Raw:
+            tag = COMPILED_RAW;
+            break;
+
+        case cJSON_rsf_Array:
+            tag = COMPILED_ARRAY;
+            break;
+
+        case cJSON_rsf_Object:
+            tag = COMPILED_OBJECT;
+            break;
+
+        default:
+            return false;
+    }
+
+    if (item->string != NULL)
+    {
+        tag |= COMPILED_HAS_KEY;
+    }
+
+    compile_bytes(output, &tag, 1);
+    output->nodes++;
+
+    if (item->string != NULL)
+    {
+        compile_string(output, item->string);
+    }
+
+    switch (tag & ~COMPILED_HAS_KEY)
+    {
+        case COMPILED_INT8:
+        {
+            const int8_t number = (int8_t) item->valuefloat;
+            compile_bytes(output, &number, sizeof(number));
+            break;
+        }
+
+        case COMPILED_INT16:
+        {
+            const int16_t number = (int16_t) item->valuefloat;
+            compile_bytes(output, &number, sizeof(number));
+            break;
+        }
+
+        case COMPILED_FLOAT:
+            compile_bytes(output, &item->valuefloat, sizeof(float));
+            break;
+
+        case COMPILED_STRING:
+        case COMPILED_RAW:
+            compile_string(output, (item->valuestring != NULL) ? item->valuestring : "");
+            break;
+
+        case COMPILED_ARRAY:
+        case COMPILED_OBJECT:
+        {
+            const size_t count = cJSON_rsf_GetArraySize(item);
+            const uint16_t count_16 = (uint16_t) count;
+            if (count > UINT16_MAX)
+            {
+                return false;
+            }
+
+            compile_bytes(output, &count_16, sizeof(count_16));
+
+            for (child = item->child; child != NULL; child = child->next)
+            {
+                if (!compile_item(child, output, depth + 1))
+                {
+                    return false;
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+size_t cJSON_rsf_Compile(const cJSON_rsf *item, unsigned char *buffer, size_t size)
+{
+    compile_buffer output = { 0 };
+
+    if (item == NULL)
+    {
+        return 0;
+    }
+
+    output.buffer = buffer;
+    output.size = size;
+    output.offset = COMPILED_HEADER_SIZE;
+
+    if (!compile_item(item, &output, 0))
+    {
+        return 0;
+    }
+
+    if (buffer != NULL)
+    {
+        if (output.offset > size)
+        {
+            return 0;
+        }
+
+        buffer[0] = COMPILED_MAGIC_0;
+        buffer[1] = COMPILED_MAGIC_1;
+        buffer[2] = COMPILED_VERSION;
+        buffer[3] = 0;
+        memcpy(buffer + 4, &output.nodes, sizeof(uint32_t));
+    }
+
+    return output.offset;
+}
+
+typedef struct
+{
+    const unsigned char *content;
+    size_t length;
+    size_t offset;
+    cJSON_rsf *nodes;
+    uint32_t node_count;
+    uint32_t next_node;
+} load_buffer;
+
+static bool load_bytes(load_buffer * const input, void * const data, const size_t length)
+{
+    if (input->offset + length > input->length)
+    {
+        return false;
+    }
+
+    memcpy(data, input->content + input->offset, length);
+    input->offset += length;
+
+    return true;
+}
+
+static char *load_string(load_buffer * const input)
+{
+    /* strings were copied right after the nodes, so they can be used in place */
+    const unsigned char *end = NULL;
+    char *string = NULL;
+
+    if (input->offset >= input->length)
+    {
+        return NULL;
+    }
+
+    end = memchr(input->content + input->offset, '\0', input->length - input->offset);
+    if (end == NULL)
+    {
+        return NULL;
+    }
+
+    string = (char*) (input->content + input->offset);
+    input->offset = (size_t) (end - input->content) + 1;
+
+    return string;
+}
+
+static cJSON_rsf *load_item(load_buffer * const input, const size_t depth)
+{
+    unsigned char tag = 0;
+    cJSON_rsf *item = NULL;
+
+    if ((depth >= CJSON_NESTING_LIMIT) || (input->next_node >= input->node_count) || !load_bytes(input, &tag, 1))
+    {
+        return NULL;
+    }
+
+    item = &input->nodes[input->next_node++];
+    item->type = cJSON_rsf_IsReference | cJSON_rsf_StringIsConst;
+
+    if (tag & COMPILED_HAS_KEY)
+    {
+        item->string = load_string(input);
+        if (item->string == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    switch (tag & ~COMPILED_HAS_KEY)
+    {
+        case COMPILED_FALSE:
+            item->type |= cJSON_rsf_False;
+            break;
+
+        case COMPILED_TRUE:
+            item->type |= cJSON_rsf_True;
+            break;
+
+        case COMPILED_NULL:
+            item->type |= cJSON_rsf_NULL;
+            break;
+
+        case COMPILED_INT8:
+        {
+            int8_t number = 0;
+            if (!load_bytes(input, &number, sizeof(number)))
+            {
+                return NULL;
+            }
+            item->type |= cJSON_rsf_Number;
+            item->valuefloat = number;
+            break;
+        }
+
+        case COMPILED_INT16:
+        {
+            int16_t number = 0;
+            if (!load_bytes(input, &number, sizeof(number)))
+            {
+                return NULL;
+            }
+            item->type |= cJSON_rsf_Number;
+            item->valuefloat = number;
+            break;
+        }
+
+        case COMPILED_FLOAT:
+            if (!load_bytes(input, &item->valuefloat, sizeof(float)))
+            {
+                return NULL;
+            }
+            item->type |= cJSON_rsf_Number;
+            break;
+
+        case COMPILED_STRING:
+        case COMPILED_RAW:
+            item->valuestring = load_string(input);
+            if (item->valuestring == NULL)
+            {
+                return NULL;
+            }
+            item->type |= ((tag & ~COMPILED_HAS_KEY) == COMPILED_STRING) ? cJSON_rsf_String : cJSON_rsf_Raw;
+            break;
+
+        case COMPILED_ARRAY:
+        case COMPILED_OBJECT:
+        {
+            uint16_t count = 0;
+            cJSON_rsf *previous = NULL;
+            if (!load_bytes(input, &count, sizeof(count)))
+            {
+                return NULL;
+            }
+
+            item->type |= ((tag & ~COMPILED_HAS_KEY) == COMPILED_ARRAY) ? cJSON_rsf_Array : cJSON_rsf_Object;
+
+            for (uint16_t i = 0; i < count; i++)
+            {
+                cJSON_rsf *child = load_item(input, depth + 1);
+                if (child == NULL)
+                {
+                    return NULL;
+                }
+
+                if (previous == NULL)
+                {
+                    item->child = child;
+                }
+                else
+                {
+                    suffix_object(previous, child);
+                }
+
+                previous = child;
+            }
+            break;
+        }
+
+        default:
+            return NULL;
+    }
+
+    return item;
+}
+
+cJSON_rsf *cJSON_rsf_LoadCompiled(const unsigned char *buffer, size_t size)
+{
+    load_buffer input = { 0 };
+    const size_t content_length = size - COMPILED_HEADER_SIZE;
+    cJSON_rsf *root = NULL;
+
+    if ((buffer == NULL) || (size <= COMPILED_HEADER_SIZE) ||
+        (buffer[0] != COMPILED_MAGIC_0) || (buffer[1] != COMPILED_MAGIC_1) || (buffer[2] != COMPILED_VERSION))
+    {
+        return NULL;
+    }
+
+    memcpy(&input.node_count, buffer + 4, sizeof(uint32_t));
+
+    /* every node takes at least its tag byte */
+    if ((input.node_count == 0) || (input.node_count > content_length))
+    {
+        return NULL;
+    }
+
+    /* nodes and strings share a single allocation, released by cJSON_rsf_Delete on the root */
+    input.nodes = calloc(1, (input.node_count * sizeof(cJSON_rsf)) + content_length);
+    if (input.nodes == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(&input.nodes[input.node_count], buffer + COMPILED_HEADER_SIZE, content_length);
+    input.content = (const unsigned char*) &input.nodes[input.node_count];
+    input.length = content_length;
+
+    root = load_item(&input, 0);
+    if ((root == NULL) || (input.offset != input.length) || (input.next_node != input.node_count))
+    {
+        free(input.nodes);
+        return NULL;
+    }
+
+    /* root item owns the arena */
+    root->type = (root->type & ~cJSON_rsf_IsReference) | cJSON_rsf_IsArena;
+
+    return root;
+}
+
 void* cJSON_rsf_malloc(size_t size)
 {
     return malloc(size);
@@ -51,6 +51,7 @@ extern "C"
 
 #define cJSON_rsf_IsReference 256
 #define cJSON_rsf_StringIsConst 512
+#define cJSON_rsf_IsArena 1024
 
 /* The cJSON_rsf structure: */
 typedef struct _cJSON_rsf {
@@ -65,6 +66,8 @@ typedef struct _cJSON_rsf {
         char* valuestring;
         /* The item's number, if type==cJSON_rsf_Number */
         float valuefloat;
+        /* Member lookup index, if type==cJSON_rsf_Object. Built on demand, owned by the item */
+        struct _cJSON_rsf_index *index;
     };
     
     /* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
@@ -81,8 +84,26 @@ typedef struct _cJSON_rsf {
 #define CJSON_NESTING_LIMIT 1000
 #endif
 
+/* Objects with at least this number of members get a lookup index on first
+ * cJSON_rsf_GetObjectItemCaseSensitive() call. Set to 0 to disable. */
+#ifndef CJSON_OBJECT_INDEX_MIN_SIZE
+#define CJSON_OBJECT_INDEX_MIN_SIZE 6
+#endif
+
+/* Cursor for sequential array access. Zero initialize before first use. */
+typedef struct {
+    struct _cJSON_rsf *item;
+    int index;
+} cJSON_rsf_Cursor;
+
 /* Supply a block of JSON, and this returns a cJSON_rsf object you can interrogate. */
 cJSON_rsf* cJSON_rsf_Parse(const char *value);
+/* Same as Parse, but all items and strings share one allocation sized from value, to avoid heap fragmentation.
+ * Tree is read only: release it only with cJSON_rsf_Delete on returned root. */
+cJSON_rsf* cJSON_rsf_ParseArena(const char *value);
+/* Same as ParseArena, but strings are unescaped inside value and point into it, so value is modified and must
+ * outlive returned tree. If arena can not be allocated, value is parsed as Parse does and is left untouched. */
+cJSON_rsf* cJSON_rsf_ParseInSitu(char *value);
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 cJSON_rsf* cJSON_rsf_ParseWithOpts(const char *value, bool require_null_terminated);
 
@@ -95,6 +116,9 @@ char* cJSON_rsf_PrintBuffered(const cJSON_rsf *item, int prebuffer, bool fmt);
 /* Render a cJSON_rsf entity to text using a buffer already allocated in memory with given length. Returns 1 on success and 0 on failure. */
 /* NOTE: cJSON_rsf is not always 100% accurate in estimating how much memory it will use, so to be safe allocate 5 bytes more than you actually need */
 bool cJSON_rsf_PrintPreallocated(cJSON_rsf *item, char *buffer, const int length, const bool format);
+/* Write number into buffer (at least 16 bytes) as printf "%1.7g" does, using only integer operations.
+ * Returns length, or 0 if number needs exponent notation or more than 7 digits to be written exactly. */
+int cJSON_rsf_FormatNumber(const float number, char *buffer);
 /* Delete a cJSON_rsf entity and all subentities. */
 void cJSON_rsf_Delete(cJSON_rsf *c);
 
@@ -102,6 +126,8 @@ void cJSON_rsf_Delete(cJSON_rsf *c);
 size_t cJSON_rsf_GetArraySize(const cJSON_rsf *array);
 /* Retrieve item number "index" from array "array". Returns NULL if unsuccessful. */
 cJSON_rsf* cJSON_rsf_GetArrayItem(const cJSON_rsf *array, int index);
+/* Same as GetArrayItem, but walks from last position saved in cursor, so increasing indexes are O(1) each. */
+cJSON_rsf* cJSON_rsf_GetArrayItemCursor(const cJSON_rsf *array, int index, cJSON_rsf_Cursor *cursor);
 /* Get item "string" from object. Case insensitive. */
 cJSON_rsf* cJSON_rsf_GetObjectItem(const cJSON_rsf * const object, const char * const string);
 cJSON_rsf* cJSON_rsf_GetObjectItemCaseSensitive(const cJSON_rsf * const object, const char * const string);
@@ -208,6 +234,13 @@ float cJSON_rsf_SetNumberHelper(cJSON_rsf *object, float number);
 /* Macro for iterating over an array or object */
 #define cJSON_rsf_ArrayForEach(element, array) for(element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
 
+/* Serialize a cJSON_rsf tree into a compact binary form that can be loaded without parsing any text.
+ * With buffer NULL returns the needed size. Returns bytes written, or 0 on failure or if size is too small. */
+size_t cJSON_rsf_Compile(const cJSON_rsf *item, unsigned char *buffer, size_t size);
+/* Build a cJSON_rsf tree from cJSON_rsf_Compile output using a single allocation. Buffer can be released after this call.
+ * Tree is read only: release it only with cJSON_rsf_Delete on returned root. Returns NULL if data is invalid. */
+cJSON_rsf* cJSON_rsf_LoadCompiled(const unsigned char *buffer, size_t size);
+
 /* malloc/free objects using the malloc/free functions that have been set with cJSON_rsf_InitHooks */
 void* cJSON_rsf_malloc(size_t size);
 void cJSON_rsf_free(void *object);
@@ -0,0 +1,8 @@
+# Component makefile for hist_flash
+
+INC_DIRS += $(hist_flash_ROOT)
+
+hist_flash_INC_DIR = $(hist_flash_ROOT)
+hist_flash_SRC_DIR = $(hist_flash_ROOT)
+
+$(eval $(call component_compile_rules,hist_flash))
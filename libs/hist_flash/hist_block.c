@@ -0,0 +1,243 @@
+/*
+ * RavenSystem Data History Blocks
+ *
+ * Copyright 2026 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ */
+
+#include <string.h>
+
+#include "hist_block.h"
+
+static inline uint32_t hist_block_zigzag(const int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static inline int32_t hist_block_unzigzag(const uint32_t value) {
+    return (int32_t) ((value >> 1) ^ -(value & 1));
+}
+
+static inline unsigned int hist_block_width(uint32_t value) {
+    unsigned int width = 0;
+    while (value) {
+        width++;
+        value >>= 1;
+    }
+    
+    return width;
+}
+
+static void hist_block_put_bits(uint8_t* data, uint32_t* pos, const uint32_t value, const unsigned int bits) {
+    for (int i = bits - 1; i >= 0; i--) {
+        const uint32_t byte = *pos >> 3;
+        const unsigned int shift = 7 - (*pos & 7);
+        
+        if (shift == 7) {
+            data[byte] = 0;
+        }
+        
+        data[byte] |= ((value >> i) & 1) << shift;
+        (*pos)++;
+    }
+}
+
+static bool hist_block_get_bits(const uint8_t* data, uint32_t* pos, const uint32_t total_bits, const unsigned int bits, uint32_t* value) {
+    if (*pos + bits > total_bits) {
+        return false;
+    }
+    
+    uint32_t result = 0;
+    for (unsigned int i = 0; i < bits; i++) {
+        result = (result << 1) | ((data[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+        (*pos)++;
+    }
+    
+    *value = result;
+    
+    return true;
+}
+
+// Time bucket of a zigzag delta of delta: prefix bits, prefix length and payload length
+static void hist_block_time_bucket(const uint32_t zigzag, uint32_t* prefix, unsigned int* prefix_bits, unsigned int* bits) {
+    if (zigzag == 0) {
+        *prefix = 0b0;
+        *prefix_bits = 1;
+        *bits = 0;
+    } else if (zigzag < (1 << 7)) {
+        *prefix = 0b10;
+        *prefix_bits = 2;
+        *bits = 7;
+    } else if (zigzag < (1 << 9)) {
+        *prefix = 0b110;
+        *prefix_bits = 3;
+        *bits = 9;
+    } else if (zigzag < (1 << 12)) {
+        *prefix = 0b1110;
+        *prefix_bits = 4;
+        *bits = 12;
+    } else {
+        *prefix = 0b1111;
+        *prefix_bits = 4;
+        *bits = 32;
+    }
+}
+
+void hist_block_start(hist_block_encoder_t* encoder, uint8_t* block, const uint16_t block_size, const uint32_t time, const int32_t value) {
+    encoder->block = block;
+    encoder->block_size = block_size;
+    encoder->count = 1;
+    encoder->bits = 0;
+    
+    encoder->last_time = time;
+    encoder->last_delta = 0;
+    encoder->last_value = value;
+    encoder->last_width = 0;
+    
+    block[0] = HIST_BLOCK_MAGIC;
+    block[1] = HIST_BLOCK_VERSION;
+    memcpy(block + 2, &encoder->count, sizeof(uint16_t));
+    memcpy(block + 4, &time, sizeof(uint32_t));
+    memcpy(block + 8, &value, sizeof(int32_t));
+}
+
+bool hist_block_add(hist_block_encoder_t* encoder, const uint32_t time, const int32_t value) {
+    if (encoder->count == UINT16_MAX) {
+        return false;
+    }
+    
+    const int32_t delta = (int32_t) (time - encoder->last_time);
+    const uint32_t time_zigzag = hist_block_zigzag((int32_t) ((uint32_t) delta - (uint32_t) encoder->last_delta));
+    uint32_t time_prefix;
+    unsigned int time_prefix_bits, time_bits;
+    hist_block_time_bucket(time_zigzag, &time_prefix, &time_prefix_bits, &time_bits);
+    
+    const uint32_t value_zigzag = hist_block_zigzag((int32_t) ((uint32_t) value - (uint32_t) encoder->last_value));
+    const unsigned int width = hist_block_width(value_zigzag);
+    unsigned int value_bits;
+    if (value_zigzag == 0) {
+        value_bits = 1;
+    } else if (width <= encoder->last_width) {
+        value_bits = 2 + encoder->last_width;
+    } else {
+        value_bits = 2 + 5 + width;
+    }
+    
+    const uint32_t needed_bits = encoder->bits + time_prefix_bits + time_bits + value_bits;
+    if (HIST_BLOCK_HEADER_SIZE + ((needed_bits + 7) >> 3) > encoder->block_size) {
+        return false;
+    }
+    
+    uint8_t* data = encoder->block + HIST_BLOCK_HEADER_SIZE;
+    
+    hist_block_put_bits(data, &encoder->bits, time_prefix, time_prefix_bits);
+    if (time_bits > 0) {
+        hist_block_put_bits(data, &encoder->bits, time_zigzag, time_bits);
+    }
+    
+    if (value_zigzag == 0) {
+        hist_block_put_bits(data, &encoder->bits, 0b0, 1);
+    } else if (width <= encoder->last_width) {
+        hist_block_put_bits(data, &encoder->bits, 0b10, 2);
+        hist_block_put_bits(data, &encoder->bits, value_zigzag, encoder->last_width);
+    } else {
+        hist_block_put_bits(data, &encoder->bits, 0b11, 2);
+        hist_block_put_bits(data, &encoder->bits, width - 1, 5);
+        hist_block_put_bits(data, &encoder->bits, value_zigzag, width);
+        encoder->last_width = width;
+    }
+    
+    encoder->count++;
+    memcpy(encoder->block + 2, &encoder->count, sizeof(uint16_t));
+    
+    encoder->last_time = time;
+    encoder->last_delta = delta;
+    encoder->last_value = value;
+    
+    return true;
+}
+
+uint16_t hist_block_size(const hist_block_encoder_t* encoder) {
+    return HIST_BLOCK_HEADER_SIZE + ((encoder->bits + 7) >> 3);
+}
+
+int hist_block_decode(const uint8_t* block, const size_t size, hist_block_decode_fn_t callback, void* args) {
+    if (size < HIST_BLOCK_HEADER_SIZE ||
+        block[0] != HIST_BLOCK_MAGIC ||
+        block[1] != HIST_BLOCK_VERSION) {
+        return -1;
+    }
+    
+    uint16_t count;
+    uint32_t time;
+    int32_t value;
+    memcpy(&count, block + 2, sizeof(uint16_t));
+    memcpy(&time, block + 4, sizeof(uint32_t));
+    memcpy(&value, block + 8, sizeof(int32_t));
+    
+    if (count == 0) {
+        return 0;
+    }
+    
+    callback(args, time, value);
+    
+    const uint8_t* data = block + HIST_BLOCK_HEADER_SIZE;
+    const uint32_t total_bits = (size - HIST_BLOCK_HEADER_SIZE) << 3;
+    uint32_t pos = 0;
+    int32_t delta = 0;
+    unsigned int width = 0;
+    
+    for (unsigned int i = 1; i < count; i++) {
+        uint32_t bit, payload;
+        
+        // Time
+        unsigned int ones = 0;
+        while (ones < 4) {
+            if (!hist_block_get_bits(data, &pos, total_bits, 1, &bit)) {
+                return -1;
+            }
+            
+            if (!bit) {
+                break;
+            }
+            
+            ones++;
+        }
+        
+        payload = 0;
+        const unsigned int time_bits[5] = { 0, 7, 9, 12, 32 };
+        if (time_bits[ones] > 0 && !hist_block_get_bits(data, &pos, total_bits, time_bits[ones], &payload)) {
+            return -1;
+        }
+        
+        delta = (int32_t) ((uint32_t) delta + (uint32_t) hist_block_unzigzag(payload));
+        time += delta;
+        
+        // Value
+        if (!hist_block_get_bits(data, &pos, total_bits, 1, &bit)) {
+            return -1;
+        }
+        
+        if (bit) {
+            if (!hist_block_get_bits(data, &pos, total_bits, 1, &bit)) {
+                return -1;
+            }
+            
+            if (bit) {
+                if (!hist_block_get_bits(data, &pos, total_bits, 5, &payload)) {
+                    return -1;
+                }
+                width = payload + 1;
+            }
+            
+            if (width == 0 || !hist_block_get_bits(data, &pos, total_bits, width, &payload)) {
+                return -1;
+            }
+            
+            value = (int32_t) ((uint32_t) value + (uint32_t) hist_block_unzigzag(payload));
+        }
+        
+        callback(args, time, value);
+    }
+    
+    return count;
+}
@@ -0,0 +1,77 @@
+/*
+ * RavenSystem Data History Blocks
+ *
+ * Copyright 2026 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ */
+
+#ifndef __HIST_BLOCK_H__
+#define __HIST_BLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Compressed block of (time, value) registers. Every block can be decoded
+ * alone, without previous blocks.
+ *
+ * Header (12 bytes, little endian):
+ *   magic (1) = HIST_BLOCK_MAGIC, version (1), count (2), time (4), value (4)
+ *
+ * Then a bit stream, MSB first, with one entry for each next register:
+ *
+ *   Time, as zigzag of delta of delta:
+ *     '0'                      same delta as previous register
+ *     '10'   + 7 bits
+ *     '110'  + 9 bits
+ *     '1110' + 12 bits
+ *     '1111' + 32 bits
+ *
+ *   Value, as zigzag of delta:
+ *     '0'                      same value as previous register
+ *     '10'  + W bits           same width W as last written value
+ *     '11'  + 5 bits (W - 1) + W bits
+ *
+ * First delta of delta is the first delta itself.
+ */
+
+#define HIST_BLOCK_MAGIC                (0xB7)
+#define HIST_BLOCK_VERSION              (1)
+#define HIST_BLOCK_HEADER_SIZE          (12)
+
+typedef struct _hist_block_encoder {
+    uint8_t* block;
+    uint16_t block_size;
+    uint16_t count;
+    uint32_t bits;
+    
+    uint32_t last_time;
+    int32_t last_delta;
+    int32_t last_value;
+    uint8_t last_width;
+} hist_block_encoder_t;
+
+typedef void (*hist_block_decode_fn_t)(void* args, const uint32_t time, const int32_t value);
+
+// Starts a new block with its first register. block_size must be at least HIST_BLOCK_HEADER_SIZE.
+void hist_block_start(hist_block_encoder_t* encoder, uint8_t* block, const uint16_t block_size, const uint32_t time, const int32_t value);
+
+// Returns false, leaving block unchanged, if register does not fit.
+bool hist_block_add(hist_block_encoder_t* encoder, const uint32_t time, const int32_t value);
+
+// Used bytes of block
+uint16_t hist_block_size(const hist_block_encoder_t* encoder);
+
+// Returns number of decoded registers, or -1 if block is not valid.
+int hist_block_decode(const uint8_t* block, const size_t size, hist_block_decode_fn_t callback, void* args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HIST_BLOCK_H__
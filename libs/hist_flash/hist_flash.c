@@ -0,0 +1,338 @@
+/*
+ * RavenSystem Flash Data History
+ *
+ * Copyright 2026 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+
+#include "esp_partition.h"
+#include "spi_flash_mmap.h"
+
+static const esp_partition_t* hist_partition = NULL;
+
+#define HIST_FLASH_PARTITION_LABEL      "hist"
+
+#define hist_flash_read_raw(addr, buffer, size)     (esp_partition_read(hist_partition, (addr), (buffer), (size)) == ESP_OK)
+#define hist_flash_write_raw(addr, data, size)      (esp_partition_write(hist_partition, (addr), (data), (size)) == ESP_OK)
+#define hist_flash_erase_sector_raw(addr)           (esp_partition_erase_range(hist_partition, (addr), SPI_FLASH_SEC_SIZE) == ESP_OK)
+
+#else   // ESP-OPEN-RTOS
+
+#include <spiflash.h>
+#include <flashchip.h>
+
+#define hist_flash_read_raw(addr, buffer, size)     spiflash_read((addr), (uint8_t*) (buffer), (size))
+#define hist_flash_write_raw(addr, data, size)      spiflash_write((addr), (uint8_t*) (data), (size))
+#define hist_flash_erase_sector_raw(addr)           spiflash_erase_sector(addr)
+
+#define HIST_FLASH_SDK_RESERVED_SECTORS (5)     // RF calibration, PHY init data and system parameters at end of flash
+
+#endif
+
+#include "hist_flash.h"
+
+#define HIST_FLASH_SECTOR_SIZE          (4096)
+#define HIST_FLASH_PAGE_SIZE            (256)
+#define HIST_FLASH_HEADER_SIZE          (16)
+#define HIST_FLASH_PAYLOAD_SIZE         (HIST_FLASH_PAGE_SIZE - HIST_FLASH_HEADER_SIZE)
+#define HIST_FLASH_PAGES_BY_SECTOR      (HIST_FLASH_SECTOR_SIZE / HIST_FLASH_PAGE_SIZE)
+#define HIST_FLASH_MAX_SAMPLES_BY_PAGE  (255)
+#define HIST_FLASH_EMPTY_SEQ            (0xFFFFFFFF)
+#define HIST_FLASH_MAX_ENCODED_SIZE     (10)    // 2 varints of 5 bytes
+
+typedef struct __attribute__((packed)) _hist_flash_header {
+    uint32_t seq;
+    uint32_t time;          // First sample, as is
+    int32_t value;
+    uint8_t count;          // Samples in page
+    uint8_t len;            // Used payload bytes
+    uint16_t checksum;      // Of payload
+} hist_flash_header_t;
+
+struct _hist_flash {
+    uint32_t base_addr;
+    uint16_t pages;
+    uint16_t head;          // Next page to write
+    uint32_t seq;           // Next page sequence
+    
+    uint32_t last_time;
+    int32_t last_value;
+    
+    hist_flash_header_t header __attribute__((aligned(4)));
+    uint8_t payload[HIST_FLASH_PAYLOAD_SIZE] __attribute__((aligned(4)));
+};
+
+static inline uint32_t hist_flash_page_addr(hist_flash_t* hist_flash, const uint16_t page) {
+    return hist_flash->base_addr + (page * HIST_FLASH_PAGE_SIZE);
+}
+
+static uint16_t hist_flash_checksum(const uint8_t* payload, const uint8_t len) {
+    uint16_t sum1 = 0, sum2 = 0;
+    
+    for (unsigned int i = 0; i < len; i++) {
+        sum1 = (sum1 + payload[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    
+    return (sum2 << 8) | sum1;
+}
+
+static unsigned int hist_flash_varint_encode(uint8_t* buffer, const int32_t value) {
+    uint32_t zigzag = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+    unsigned int size = 0;
+    
+    while (zigzag >= 0x80) {
+        buffer[size++] = (zigzag & 0x7F) | 0x80;
+        zigzag >>= 7;
+    }
+    
+    buffer[size++] = zigzag;
+    
+    return size;
+}
+
+static unsigned int hist_flash_varint_decode(const uint8_t* buffer, const unsigned int len, int32_t* value) {
+    uint32_t zigzag = 0;
+    unsigned int size = 0;
+    
+    while (size < len && size < 5) {
+        const uint8_t byte = buffer[size];
+        zigzag |= (uint32_t) (byte & 0x7F) << (7 * size);
+        size++;
+        
+        if (!(byte & 0x80)) {
+            *value = (int32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+            return size;
+        }
+    }
+    
+    return 0;
+}
+
+static void hist_flash_page_reset(hist_flash_t* hist_flash) {
+    memset(&hist_flash->header, 0xFF, sizeof(hist_flash_header_t));
+    memset(hist_flash->payload, 0xFF, HIST_FLASH_PAYLOAD_SIZE);
+    hist_flash->header.count = 0;
+    hist_flash->header.len = 0;
+}
+
+static bool hist_flash_page_is_blank(hist_flash_t* hist_flash, const uint16_t page) {
+    uint32_t buffer[HIST_FLASH_HEADER_SIZE / sizeof(uint32_t)];
+    const uint32_t addr = hist_flash_page_addr(hist_flash, page);
+    
+    for (unsigned int i = 0; i < HIST_FLASH_PAGE_SIZE; i += sizeof(buffer)) {
+        if (!hist_flash_read_raw(addr + i, buffer, sizeof(buffer))) {
+            return false;
+        }
+        
+        for (unsigned int j = 0; j < (sizeof(buffer) / sizeof(uint32_t)); j++) {
+            if (buffer[j] != 0xFFFFFFFF) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+static int hist_flash_write_page(hist_flash_t* hist_flash) {
+    const uint16_t page = hist_flash->head;
+    const uint32_t addr = hist_flash_page_addr(hist_flash, page);
+    
+    hist_flash->head = (hist_flash->head + 1) % hist_flash->pages;
+    
+    if ((page % HIST_FLASH_PAGES_BY_SECTOR) == 0 && !hist_flash_erase_sector_raw(addr)) {
+        return -1;
+    }
+    
+    hist_flash->header.seq = hist_flash->seq++;
+    hist_flash->header.checksum = hist_flash_checksum(hist_flash->payload, hist_flash->header.len);
+    
+    // Header goes last, so a page is only valid after it is fully written
+    if (!hist_flash_write_raw(addr + HIST_FLASH_HEADER_SIZE, hist_flash->payload, HIST_FLASH_PAYLOAD_SIZE) ||
+        !hist_flash_write_raw(addr, &hist_flash->header, HIST_FLASH_HEADER_SIZE)) {
+        return -1;
+    }
+    
+    return 0;
+}
+
+hist_flash_t* hist_flash_new(const uint32_t first_sector, const uint16_t sectors) {
+    if (sectors == 0 || sectors >= (0x10000 / HIST_FLASH_PAGES_BY_SECTOR)) {
+        return NULL;
+    }
+    
+#ifdef ESP_PLATFORM
+    if (!hist_partition) {
+        hist_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HIST_FLASH_PARTITION_LABEL);
+        
+        if (!hist_partition) {
+            return NULL;
+        }
+    }
+    
+    if ((first_sector + sectors) * HIST_FLASH_SECTOR_SIZE > hist_partition->size) {
+        return NULL;
+    }
+#else
+    const uint32_t last_sector = (sdk_flashchip.chip_size / HIST_FLASH_SECTOR_SIZE) - HIST_FLASH_SDK_RESERVED_SECTORS;
+    if (first_sector >= last_sector || sectors > last_sector - first_sector) {
+        return NULL;
+    }
+#endif
+    
+    hist_flash_t* hist_flash = malloc(sizeof(hist_flash_t));
+    if (!hist_flash) {
+        return NULL;
+    }
+    
+    hist_flash->base_addr = first_sector * HIST_FLASH_SECTOR_SIZE;
+    hist_flash->pages = sectors * HIST_FLASH_PAGES_BY_SECTOR;
+    hist_flash->head = 0;
+    hist_flash->seq = 0;
+    hist_flash->last_time = 0;
+    hist_flash->last_value = 0;
+    
+    // Find newest page
+    bool found = false;
+    for (unsigned int page = 0; page < hist_flash->pages; page++) {
+        uint32_t seq;
+        if (hist_flash_read_raw(hist_flash_page_addr(hist_flash, page), &seq, sizeof(seq)) &&
+            seq != HIST_FLASH_EMPTY_SEQ &&
+            (!found || seq >= hist_flash->seq)) {
+            found = true;
+            hist_flash->seq = seq + 1;
+            hist_flash->head = (page + 1) % hist_flash->pages;
+        }
+    }
+    
+    // An interrupted write can leave data in a page without header. Pages at
+    // sector start are erased before writing, but others must be blank.
+    for (unsigned int i = 0; i < hist_flash->pages &&
+         (hist_flash->head % HIST_FLASH_PAGES_BY_SECTOR) != 0 &&
+         !hist_flash_page_is_blank(hist_flash, hist_flash->head); i++) {
+        hist_flash->head = (hist_flash->head + 1) % hist_flash->pages;
+    }
+    
+    hist_flash_page_reset(hist_flash);
+    
+    return hist_flash;
+}
+
+int hist_flash_add(hist_flash_t* hist_flash, const uint32_t time, const int32_t value) {
+    int result = 0;
+    
+    if (hist_flash->header.count > 0) {
+        uint8_t encoded[HIST_FLASH_MAX_ENCODED_SIZE];
+        unsigned int size = hist_flash_varint_encode(encoded, (int32_t) (time - hist_flash->last_time));
+        size += hist_flash_varint_encode(encoded + size, (int32_t) ((uint32_t) value - (uint32_t) hist_flash->last_value));
+        
+        if (hist_flash->header.len + size <= HIST_FLASH_PAYLOAD_SIZE &&
+            hist_flash->header.count < HIST_FLASH_MAX_SAMPLES_BY_PAGE) {
+            memcpy(hist_flash->payload + hist_flash->header.len, encoded, size);
+            hist_flash->header.len += size;
+            hist_flash->header.count++;
+            
+            hist_flash->last_time = time;
+            hist_flash->last_value = value;
+            
+            return 0;
+        }
+        
+        result = hist_flash_write_page(hist_flash);
+        hist_flash_page_reset(hist_flash);
+    }
+    
+    hist_flash->header.time = time;
+    hist_flash->header.value = value;
+    hist_flash->header.count = 1;
+    
+    hist_flash->last_time = time;
+    hist_flash->last_value = value;
+    
+    return result;
+}
+
+int hist_flash_flush(hist_flash_t* hist_flash) {
+    int result = 0;
+    
+    if (hist_flash->header.count > 0) {
+        result = hist_flash_write_page(hist_flash);
+        hist_flash_page_reset(hist_flash);
+    }
+    
+    return result;
+}
+
+static unsigned int hist_flash_read_page(const hist_flash_header_t* header, const uint8_t* payload, hist_flash_read_fn_t callback, void* args) {
+    uint32_t time = header->time;
+    int32_t value = header->value;
+    unsigned int pos = 0;
+    unsigned int count = 1;
+    
+    callback(args, time, value);
+    
+    while (count < header->count) {
+        int32_t delta_time, delta_value;
+        unsigned int size = hist_flash_varint_decode(payload + pos, header->len - pos, &delta_time);
+        if (size == 0) {
+            break;
+        }
+        pos += size;
+        
+        size = hist_flash_varint_decode(payload + pos, header->len - pos, &delta_value);
+        if (size == 0) {
+            break;
+        }
+        pos += size;
+        
+        time += delta_time;
+        value = (int32_t) ((uint32_t) value + (uint32_t) delta_value);
+        callback(args, time, value);
+        count++;
+    }
+    
+    return count;
+}
+
+unsigned int hist_flash_read(hist_flash_t* hist_flash, hist_flash_read_fn_t callback, void* args) {
+    unsigned int total = 0;
+    
+    uint8_t* payload = malloc(HIST_FLASH_PAYLOAD_SIZE);
+    if (!payload) {
+        return 0;
+    }
+    
+    // Oldest page is the first written one after head
+    for (unsigned int i = 0; i < hist_flash->pages; i++) {
+        const uint16_t page = (hist_flash->head + i) % hist_flash->pages;
+        const uint32_t addr = hist_flash_page_addr(hist_flash, page);
+        hist_flash_header_t header __attribute__((aligned(4)));
+        
+        if (!hist_flash_read_raw(addr, &header, HIST_FLASH_HEADER_SIZE) ||
+            header.seq == HIST_FLASH_EMPTY_SEQ ||
+            header.count == 0 ||
+            header.len > HIST_FLASH_PAYLOAD_SIZE ||
+            !hist_flash_read_raw(addr + HIST_FLASH_HEADER_SIZE, payload, HIST_FLASH_PAYLOAD_SIZE) ||
+            header.checksum != hist_flash_checksum(payload, header.len)) {
+            continue;
+        }
+        
+        total += hist_flash_read_page(&header, payload, callback, args);
+    }
+    
+    free(payload);
+    
+    // Samples not written to flash yet
+    if (hist_flash->header.count > 0) {
+        total += hist_flash_read_page(&hist_flash->header, hist_flash->payload, callback, args);
+    }
+    
+    return total;
+}
@@ -0,0 +1,44 @@
+/*
+ * RavenSystem Flash Data History
+ *
+ * Copyright 2026 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ */
+
+#ifndef __HIST_FLASH_H__
+#define __HIST_FLASH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Time series ring stored in a dedicated flash sector range.
+ *
+ * Samples are buffered in RAM and written as whole 256 bytes pages. Each page
+ * keeps first sample as is, and next ones as zigzag varint deltas of time and
+ * value. Oldest sector is erased when ring wraps.
+ *
+ * ESP8266: first_sector is an absolute flash sector. Last 5 sectors of chip
+ *          are reserved by SDK and rejected.
+ * ESP32:   first_sector is relative to the "hist" data partition.
+ */
+
+typedef struct _hist_flash hist_flash_t;
+
+typedef void (*hist_flash_read_fn_t)(void* args, const uint32_t time, const int32_t value);
+
+hist_flash_t* hist_flash_new(const uint32_t first_sector, const uint16_t sectors);
+int hist_flash_add(hist_flash_t* hist_flash, const uint32_t time, const int32_t value);
+int hist_flash_flush(hist_flash_t* hist_flash);
+
+// Calls callback with all stored samples, from oldest to newest. Returns number of samples.
+unsigned int hist_flash_read(hist_flash_t* hist_flash, hist_flash_read_fn_t callback, void* args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HIST_FLASH_H__
@@ -203,6 +203,8 @@ struct _homekit_characteristic {
     
     homekit_value_t (*getter_ex)(const homekit_characteristic_t *ch);
     void (*setter_ex)(homekit_characteristic_t *ch, const homekit_value_t value);
+    
+    void *context;  // Owner data, not used by library
 };
 
 struct _homekit_service {
@@ -277,6 +277,7 @@ homekit_characteristic_t* homekit_characteristic_clone(homekit_characteristic_t*
     //clone->subscriptions = ch->subscriptions;
     clone->getter_ex = ch->getter_ex;
     clone->setter_ex = ch->setter_ex;
+    clone->context = ch->context;
 
     return clone;
 }
@@ -6,6 +6,7 @@
 #include <wolfssl/wolfcrypt/ed25519.h>
 #include <wolfssl/wolfcrypt/curve25519.h>
 #include <wolfssl/wolfcrypt/sha512.h>
+#include <wolfssl/wolfcrypt/hash.h>
 #include <wolfssl/wolfcrypt/chacha20_poly1305.h>
 #include <wolfssl/wolfcrypt/srp.h>
 #include <wolfssl/wolfcrypt/error-crypt.h>
@@ -430,6 +431,116 @@ int crypto_ed25519_verify(
 }
 
 
+typedef struct _ed25519_expanded_key {
+    byte az[ED25519_PRV_KEY_SIZE];      // Clamped scalar (32) + nonce prefix (32)
+    byte public_key[ED25519_PUB_KEY_SIZE];
+} ed25519_expanded_key;
+
+static void crypto_memzero(void *data, size_t size) {
+    volatile byte *p = data;
+    while (size--) {
+        *p++ = 0;
+    }
+}
+
+void crypto_ed25519_expanded_key_free(ed25519_expanded_key *expanded_key) {
+    if (expanded_key) {
+        crypto_memzero(expanded_key, sizeof(ed25519_expanded_key));
+        free(expanded_key);
+    }
+}
+
+ed25519_expanded_key *crypto_ed25519_expand_key(const ed25519_key *key) {
+    ed25519_expanded_key *expanded_key = malloc(sizeof(ed25519_expanded_key));
+    if (!expanded_key) {
+        return NULL;
+    }
+    
+    int r = wc_Sha512Hash(key->k, ED25519_KEY_SIZE, expanded_key->az);
+    if (r) {
+        DEBUG("Failed to expand key (code %d)", r);
+        crypto_ed25519_expanded_key_free(expanded_key);
+        return NULL;
+    }
+    
+    expanded_key->az[0]  &= 248;
+    expanded_key->az[31] &= 63;
+    expanded_key->az[31] |= 64;
+    
+    memcpy(expanded_key->public_key, key->p, ED25519_PUB_KEY_SIZE);
+    
+    return expanded_key;
+}
+
+// Same as wc_ed25519_sign_msg(), but skipping private key SHA-512 expansion
+int crypto_ed25519_sign_expanded(
+    const ed25519_expanded_key *expanded_key,
+    const byte *message, size_t message_size,
+    byte *signature, size_t *signature_size
+) {
+    if (signature_size == NULL) {
+        return -1;
+    }
+
+    if (*signature_size < ED25519_SIG_SIZE) {
+        *signature_size = ED25519_SIG_SIZE;
+        return -2;
+    }
+    
+    *signature_size = ED25519_SIG_SIZE;
+    
+    ge_p3 R;
+    byte nonce[WC_SHA512_DIGEST_SIZE];
+    byte hram[WC_SHA512_DIGEST_SIZE];
+    wc_Sha512 sha;
+    
+    // r = H(prefix, M)
+    int r = wc_InitSha512(&sha);
+    if (!r) {
+        r = wc_Sha512Update(&sha, expanded_key->az + ED25519_KEY_SIZE, ED25519_KEY_SIZE);
+    }
+    if (!r) {
+        r = wc_Sha512Update(&sha, message, message_size);
+    }
+    if (!r) {
+        r = wc_Sha512Final(&sha, nonce);
+    }
+    if (r) {
+        return r;
+    }
+    
+    // R = rB
+    sc_reduce(nonce);
+    ge_scalarmult_base(&R, nonce);
+    ge_p3_tobytes(signature, &R);
+    
+    // S = (r + H(R, A, M) * a) mod l
+    r = wc_InitSha512(&sha);
+    if (!r) {
+        r = wc_Sha512Update(&sha, signature, ED25519_SIG_SIZE / 2);
+    }
+    if (!r) {
+        r = wc_Sha512Update(&sha, expanded_key->public_key, ED25519_PUB_KEY_SIZE);
+    }
+    if (!r) {
+        r = wc_Sha512Update(&sha, message, message_size);
+    }
+    if (!r) {
+        r = wc_Sha512Final(&sha, hram);
+    }
+    
+    if (!r) {
+        sc_reduce(hram);
+        sc_muladd(signature + (ED25519_SIG_SIZE / 2), hram, expanded_key->az, nonce);
+    }
+    
+    // clean up nonce from stack for security
+    crypto_memzero(nonce, sizeof(nonce));
+    
+    return r;
+}
+
+
 curve25519_key *crypto_curve25519_new() {
     curve25519_key *key = malloc(sizeof(curve25519_key));
     int r = wc_curve25519_init(key);
@@ -90,6 +90,22 @@ int crypto_ed25519_verify(
     const byte *signature, size_t signature_size
 );
 
+// ED25519 expanded private key (clamped SHA-512 of seed), kept in RAM to sign
+// without re-deriving scalar and prefix every time
+#define CRYPTO_ED25519_SIGNATURE_SIZE 64  // ED25519_SIG_SIZE
+
+struct _ed25519_expanded_key;
+typedef struct _ed25519_expanded_key ed25519_expanded_key;
+
+ed25519_expanded_key *crypto_ed25519_expand_key(const ed25519_key *key);
+void crypto_ed25519_expanded_key_free(ed25519_expanded_key *expanded_key);
+
+int crypto_ed25519_sign_expanded(
+    const ed25519_expanded_key *expanded_key,
+    const byte *message, size_t message_size,
+    byte *signature, size_t *signature_size
+);
+
 
 // CURVE25519
 struct _curve25519_key;
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <cJSON_rsf.h>
 #include "json.h"
 #include "debug.h"
 
@@ -189,14 +190,20 @@ void json_integer(json_stream *json, long int x) {
         return;
 
     void _do_write() {
-        size_t len = snprintf(NULL, 0, "%ld", x);
-        char *buffer = malloc(len + 1);
-        if (buffer) {
-            snprintf(buffer, len + 1, "%ld", x);
-            
-            json_write(json, buffer, len);
-            free(buffer);
+        char buffer[24];
+        char* p = buffer + sizeof(buffer);
+        unsigned long int value = (x < 0) ? -(unsigned long int) x : (unsigned long int) x;
+        
+        do {
+            *--p = '0' + (value % 10);
+            value /= 10;
+        } while (value > 0);
+        
+        if (x < 0) {
+            *--p = '-';
         }
+        
+        json_write(json, p, buffer + sizeof(buffer) - p);
     }
 
     switch (json->state) {
@@ -228,15 +235,14 @@ void json_float(json_stream *json, float x) {
         return;
 
     void _do_write() {
-        //snprintf(NULL, 0, "%1.15g", x);
-        size_t len = snprintf(NULL, 0, "%1.7g", x);
-        char *buffer = malloc(len + 1);
-        if (buffer) {
-            snprintf(buffer, len + 1, "%1.7g", x);
-            
-            json_write(json, buffer, len);
-            free(buffer);
+        char buffer[32];
+        int len = cJSON_rsf_FormatNumber(x, buffer);
+        if (len == 0) {
+            //snprintf(buffer, sizeof(buffer), "%1.15g", x);
+            len = snprintf(buffer, sizeof(buffer), "%1.7g", x);
         }
+        
+        json_write(json, buffer, len);
     }
 
     switch (json->state) {
@@ -18,17 +18,20 @@ void homekit_random_fill(uint8_t *data, size_t size);
 #define spiflash_erase_sector(addr)         (esp_partition_erase_range(hap_partition, (addr), SPI_FLASH_SEC_SIZE) == ESP_OK)
 #define sdk_system_restart()                esp_restart()
 #define SERVER_TASK_STACK_PAIR              (8320)
+#define EPHEMERAL_KEY_TASK_STACK            (4096)
 
 #else
 
 #include <spiflash.h>
 #define SERVER_TASK_STACK_PAIR              (1680)
 #define SERVER_TASK_STACK_NORMAL            (1280)
+#define EPHEMERAL_KEY_TASK_STACK            (1280)
 
 #endif
 
 
 #define SERVER_TASK_PRIORITY                (tskIDLE_PRIORITY + 2)
+#define EPHEMERAL_KEY_TASK_PRIORITY         (tskIDLE_PRIORITY)
 
 void homekit_port_mdns_announce_start();
 void homekit_port_mdns_announce_stop();
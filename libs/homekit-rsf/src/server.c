@@ -14,6 +14,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include "http_parser.h"
 #include "esp32_port.h"
 #include "esp_attr.h"
@@ -25,6 +26,7 @@
 
 #include <FreeRTOS.h>
 #include <task.h>
+#include <queue.h>
 #include <espressif/esp_common.h>
 #include <esplibs/libmain.h>
 #include <sysparam.h>
@@ -88,6 +90,31 @@
 #define HOMEKIT_NETWORK_PAUSE_COUNT_CRITIC      (10)
 #endif
 
+// Pair Verify M3 signature checks are offloaded to a worker task on the second core
+#if defined(ESP_PLATFORM) && !defined(CONFIG_FREERTOS_UNICORE) && !defined(HOMEKIT_DISABLE_VERIFY_WORKER)
+#define HOMEKIT_VERIFY_WORKER
+
+#ifndef HOMEKIT_VERIFY_WORKER_CORE
+#define HOMEKIT_VERIFY_WORKER_CORE              (1)
+#endif
+
+#ifndef HOMEKIT_VERIFY_WORKER_STACK
+#define HOMEKIT_VERIFY_WORKER_STACK             (4096)
+#endif
+
+#define HOMEKIT_VERIFY_WORKER_QUEUE_SIZE        (32)    // Max clients
+#define HOMEKIT_VERIFY_PENDING_SELECT_TIMEOUT   (10000)
+#endif
+
+// Pair Verify M1 takes accessory Curve25519 keys pre-generated at idle time
+#ifndef HOMEKIT_DISABLE_EPHEMERAL_KEY_POOL
+#define HOMEKIT_EPHEMERAL_KEY_POOL
+
+#ifndef HOMEKIT_EPHEMERAL_KEY_POOL_SIZE
+#define HOMEKIT_EPHEMERAL_KEY_POOL_SIZE         (2)
+#endif
+#endif
+
 #ifdef HOMEKIT_DEBUG
 #define TLV_DEBUG(values)                       tlv_debug(values)
 #else
@@ -105,6 +132,11 @@
 struct _client_context_t;
 typedef struct _client_context_t client_context_t;
 
+#ifdef HOMEKIT_VERIFY_WORKER
+struct _pair_verify_job_t;
+typedef struct _pair_verify_job_t pair_verify_job_t;
+#endif
+
 #ifdef HOMEKIT_NOTIFY_EVENT_ENABLE
 
 #define HOMEKIT_NOTIFY_EVENT(server, event) \
@@ -159,6 +191,7 @@ typedef struct _notification {
 typedef struct {
     char *accessory_id;
     ed25519_key* accessory_key;
+    ed25519_expanded_key* accessory_expanded_key;
     
     homekit_server_config_t* config;
     
@@ -176,6 +209,16 @@ typedef struct {
     bool is_pairing: 1;
     bool pending_close: 1;
     
+#ifdef HOMEKIT_EPHEMERAL_KEY_POOL
+    QueueHandle_t ephemeral_keys;
+#endif
+    
+#ifdef HOMEKIT_VERIFY_WORKER
+    QueueHandle_t verify_jobs;
+    QueueHandle_t verify_results;
+    uint8_t verify_pending;
+#endif
+    
     json_stream json;
     
     byte data[BUFFER_DATA_SIZE + 16 + 2];   // Used by JSON buffer too. Must be 2 bytes reserved for client_send_chunk() end; there are 18.
@@ -207,10 +250,29 @@ struct _client_context_t {
     int32_t count_writes;
     
     pair_verify_context_t *verify_context;
+    
+#ifdef HOMEKIT_VERIFY_WORKER
+    pair_verify_job_t *verify_job;
+#endif
 
     struct _client_context_t *next;
 };
 
+#ifdef HOMEKIT_VERIFY_WORKER
+struct _pair_verify_job_t {
+    client_context_t *client;   // NULL when client was closed while verifying
+    pair_verify_context_t *verify_context;
+    pairing_t *pairing;
+    
+    byte *device_info;
+    size_t device_info_size;
+    byte *signature;
+    size_t signature_size;
+    
+    int result;
+};
+#endif
+
 #ifdef HOMEKIT_GET_CLIENTS_INFO
 int32_t homekit_get_unique_client_ipaddr() {
     if (homekit_server && homekit_server->client_count == 1) {
@@ -267,6 +329,10 @@ void server_free() {
         crypto_ed25519_free(homekit_server->accessory_key);
     }
 
+    if (homekit_server->accessory_expanded_key) {
+        crypto_ed25519_expanded_key_free(homekit_server->accessory_expanded_key);
+    }
+
     if (homekit_server->pairing_context) {
         pairing_context_free(homekit_server->pairing_context);
     }
@@ -1646,6 +1712,127 @@ void homekit_server_on_pair_setup(client_context_t *context, const byte *data, s
     tlv_free(message);
 }
 
+void homekit_server_on_pair_verify_done(client_context_t *context, pair_verify_context_t **verify_context, const int verify_result, const byte permissions, const int pairing_id) {
+    if (verify_result) {
+        CLIENT_ERROR(context, "Verify sign (%d)", verify_result);
+
+        pair_verify_context_free(verify_context);
+
+        send_tlv_error_response(context, 4, TLVError_Authentication);
+        return;
+    }
+
+    const byte salt[] = "Control-Salt";
+
+    size_t read_key_size = 32;
+    const byte read_info[] = "Control-Read-Encryption-Key";
+    int r = crypto_hkdf(
+        (*verify_context)->secret, (*verify_context)->secret_size,
+        salt, sizeof(salt)-1,
+        read_info, sizeof(read_info)-1,
+        context->read_key, &read_key_size
+    );
+
+    if (r) {
+        CLIENT_ERROR(context, "Derive read enc key (%d)", r);
+
+        pair_verify_context_free(verify_context);
+
+        send_tlv_error_response(context, 4, TLVError_Unknown);
+        return;
+    }
+
+    size_t write_key_size = 32;
+    const byte write_info[] = "Control-Write-Encryption-Key";
+    r = crypto_hkdf(
+        (*verify_context)->secret, (*verify_context)->secret_size,
+        salt, sizeof(salt)-1,
+        write_info, sizeof(write_info)-1,
+        context->write_key, &write_key_size
+    );
+
+    pair_verify_context_free(verify_context);
+    
+    if (r) {
+        CLIENT_ERROR(context, "Derive write enc key (%d)", r);
+
+        send_tlv_error_response(context, 4, TLVError_Unknown);
+        return;
+    }
+
+    tlv_values_t *response = tlv_new();
+    tlv_add_integer_value(response, TLVType_State, 1, 4);
+    
+    send_tlv_response(context, response);
+
+    context->pairing_id = pairing_id;
+    context->permissions = permissions;
+    context->encrypted = true;
+
+    HOMEKIT_NOTIFY_EVENT(homekit_server, HOMEKIT_EVENT_CLIENT_VERIFIED);
+
+    CLIENT_INFO(context, "Verify OK");
+}
+
+#ifdef HOMEKIT_VERIFY_WORKER
+static void pair_verify_job_free(pair_verify_job_t *job) {
+    if (job->verify_context) {
+        pair_verify_context_free(&job->verify_context);
+    }
+    
+    pairing_free(job->pairing);
+    free(job->device_info);
+    free(job->signature);
+    free(job);
+}
+
+static void homekit_verify_worker_task(void *args) {
+    pair_verify_job_t *job;
+    
+    for (;;) {
+        if (xQueueReceive(homekit_server->verify_jobs, &job, portMAX_DELAY) == pdTRUE) {
+            // Worker only touches job data; client context is completed by server task
+            job->result = crypto_ed25519_verify(
+                job->pairing->device_key,
+                job->device_info, job->device_info_size,
+                job->signature, job->signature_size
+            );
+            
+            xQueueSend(homekit_server->verify_results, &job, portMAX_DELAY);
+        }
+    }
+}
+
+static void homekit_server_process_verify_results() {
+    pair_verify_job_t *job;
+    
+    while (xQueueReceive(homekit_server->verify_results, &job, 0) == pdTRUE) {
+        homekit_server->verify_pending--;
+        
+        if (job->client) {
+            job->client->verify_job = NULL;
+            homekit_server_on_pair_verify_done(job->client, &job->verify_context, job->result, job->pairing->permissions, job->pairing->id);
+        }
+        
+        pair_verify_job_free(job);
+    }
+}
+#endif
+
+#ifdef HOMEKIT_EPHEMERAL_KEY_POOL
+static void homekit_ephemeral_key_task(void *args) {
+    for (;;) {
+        // Each key is taken from queue only once, and freed after its shared secret is generated
+        curve25519_key *key = crypto_curve25519_generate();
+        if (key) {
+            xQueueSend(homekit_server->ephemeral_keys, &key, portMAX_DELAY);
+        } else {
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+        }
+    }
+}
+#endif
+
 void homekit_server_on_pair_verify(client_context_t *context, const byte *data, size_t size) {
 #ifdef HOMEKIT_PAIR_VERIFY_TIME_DEBUG
     uint32_t function_time = sdk_system_get_time_raw();
@@ -1694,8 +1881,17 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
                 break;
             }
 
-            CLIENT_DEBUG(context, "Generating accessory Curve25519 key");
-            curve25519_key *my_key = crypto_curve25519_generate();
+            curve25519_key *my_key = NULL;
+#ifdef HOMEKIT_EPHEMERAL_KEY_POOL
+            if (homekit_server->ephemeral_keys &&
+                xQueueReceive(homekit_server->ephemeral_keys, &my_key, 0) == pdTRUE) {
+                CLIENT_DEBUG(context, "Using pooled accessory Curve25519 key");
+            } else
+#endif
+            {
+                CLIENT_DEBUG(context, "Generating accessory Curve25519 key");
+                my_key = crypto_curve25519_generate();
+            }
             if (!my_key) {
                 CLIENT_ERROR(context, "Generate acc Curve key");
                 crypto_curve25519_free(device_key);
@@ -1747,19 +1943,21 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
             memcpy(accessory_info + my_key_public_size + accessory_id_size,
                    tlv_device_public_key->value, tlv_device_public_key->size);
 
-            size_t accessory_signature_size = 0;
-            crypto_ed25519_sign(
-                homekit_server->accessory_key,
-                accessory_info, accessory_info_size,
-                NULL, &accessory_signature_size
-            );
-
+            size_t accessory_signature_size = CRYPTO_ED25519_SIGNATURE_SIZE;
             byte *accessory_signature = malloc(accessory_signature_size);
-            r = crypto_ed25519_sign(
-                homekit_server->accessory_key,
-                accessory_info, accessory_info_size,
-                accessory_signature, &accessory_signature_size
-            );
+            if (homekit_server->accessory_expanded_key) {
+                r = crypto_ed25519_sign_expanded(
+                    homekit_server->accessory_expanded_key,
+                    accessory_info, accessory_info_size,
+                    accessory_signature, &accessory_signature_size
+                );
+            } else {
+                r = crypto_ed25519_sign(
+                    homekit_server->accessory_key,
+                    accessory_info, accessory_info_size,
+                    accessory_signature, &accessory_signature_size
+                );
+            }
             free(accessory_info);
             if (r) {
                 CLIENT_ERROR(context, "Generate sign (%d)", r);
@@ -1975,9 +2173,6 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
             
             free(device_id);
             
-            byte permissions = pairing->permissions;
-            int pairing_id = pairing->id;
-            
             size_t device_info_size =
                 context->verify_context->device_public_key_size +
                 context->verify_context->accessory_public_key_size +
@@ -1991,6 +2186,45 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
             memcpy(device_info + context->verify_context->device_public_key_size + tlv_device_id->size,
                    context->verify_context->accessory_public_key, context->verify_context->accessory_public_key_size);
 
+#ifdef HOMEKIT_VERIFY_WORKER
+            if (homekit_server->verify_jobs) {
+                pair_verify_job_t *job = calloc(1, sizeof(pair_verify_job_t));
+                if (job) {
+                    job->client = context;
+                    job->pairing = pairing;
+                    job->device_info = device_info;
+                    job->device_info_size = device_info_size;
+                    job->signature = malloc(tlv_device_signature->size);
+                    job->signature_size = tlv_device_signature->size;
+                    
+                    if (job->signature) {
+                        memcpy(job->signature, tlv_device_signature->value, tlv_device_signature->size);
+                        
+                        // Job takes ownership of session secret until signature is verified
+                        job->verify_context = context->verify_context;
+                        context->verify_context = NULL;
+                        
+                        if (xQueueSend(homekit_server->verify_jobs, &job, 0) == pdTRUE) {
+                            CLIENT_DEBUG(context, "Verifying sign in worker");
+                            if (context->verify_job) {
+                                // Previous verify is superseded
+                                context->verify_job->client = NULL;
+                            }
+                            context->verify_job = job;
+                            homekit_server->verify_pending++;
+                            tlv_free(decrypted_message);
+                            break;
+                        }
+                        
+                        context->verify_context = job->verify_context;
+                        free(job->signature);
+                    }
+                    
+                    free(job);
+                }
+            }
+#endif
+            
             CLIENT_DEBUG(context, "Verifying sign");
             r = crypto_ed25519_verify(
                 pairing->device_key,
@@ -1998,69 +2232,11 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
                 tlv_device_signature->value, tlv_device_signature->size
             );
             free(device_info);
-            pairing_free(pairing);
             tlv_free(decrypted_message);
-
-            if (r) {
-                CLIENT_ERROR(context, "Verify sign (%d)", r);
-
-                pair_verify_context_free(&context->verify_context);
-
-                send_tlv_error_response(context, 4, TLVError_Authentication);
-                break;
-            }
-
-            const byte salt[] = "Control-Salt";
-
-            size_t read_key_size = 32;
-            const byte read_info[] = "Control-Read-Encryption-Key";
-            r = crypto_hkdf(
-                context->verify_context->secret, context->verify_context->secret_size,
-                salt, sizeof(salt)-1,
-                read_info, sizeof(read_info)-1,
-                context->read_key, &read_key_size
-            );
-
-            if (r) {
-                CLIENT_ERROR(context, "Derive read enc key (%d)", r);
-
-                pair_verify_context_free(&context->verify_context);
-
-                send_tlv_error_response(context, 4, TLVError_Unknown);
-                break;
-            }
-
-            size_t write_key_size = 32;
-            const byte write_info[] = "Control-Write-Encryption-Key";
-            r = crypto_hkdf(
-                context->verify_context->secret, context->verify_context->secret_size,
-                salt, sizeof(salt)-1,
-                write_info, sizeof(write_info)-1,
-                context->write_key, &write_key_size
-            );
-
-            pair_verify_context_free(&context->verify_context);
             
-            if (r) {
-                CLIENT_ERROR(context, "Derive write enc key (%d)", r);
-
-                send_tlv_error_response(context, 4, TLVError_Unknown);
-                break;
-            }
-
-            tlv_values_t *response = tlv_new();
-            tlv_add_integer_value(response, TLVType_State, 1, 4);
+            homekit_server_on_pair_verify_done(context, &context->verify_context, r, pairing->permissions, pairing->id);
+            pairing_free(pairing);
             
-            send_tlv_response(context, response);
-
-            context->pairing_id = pairing_id;
-            context->permissions = permissions;
-            context->encrypted = true;
-
-            HOMEKIT_NOTIFY_EVENT(homekit_server, HOMEKIT_EVENT_CLIENT_VERIFIED);
-
-            CLIENT_INFO(context, "Verify OK");
-
             break;
         }
         default: {
@@ -3379,6 +3555,13 @@ void homekit_server_close_client(client_context_t *context) {
         homekit_server->pairing_context = NULL;
     }
     
+#ifdef HOMEKIT_VERIFY_WORKER
+    if (context->verify_job) {
+        // Pending job will be freed by server task when worker returns it
+        context->verify_job->client = NULL;
+    }
+#endif
+    
     homekit_accessories_clear_notify_subscriptions(homekit_server->config->accessories, context);
     
     HOMEKIT_NOTIFY_EVENT(homekit_server, HOMEKIT_EVENT_CLIENT_DISCONNECTED);
@@ -3604,13 +3787,20 @@ static void IRAM homekit_run_server() {
     homekit_server->max_fd = homekit_server->listen_fd;
     
     struct timeval timeout = { 0, 80000 }; /* 0.08 seconds timeout (orig: 1s) */
+#ifdef HOMEKIT_VERIFY_WORKER
+    struct timeval verify_pending_timeout = { 0, HOMEKIT_VERIFY_PENDING_SELECT_TIMEOUT };
+#endif
     int triggered_nfds;
     fd_set read_fds;
     
     for (;;) {
         memcpy(&read_fds, &homekit_server->fds, sizeof(read_fds));
         
+#ifdef HOMEKIT_VERIFY_WORKER
+        triggered_nfds = select(homekit_server->max_fd + 1, &read_fds, NULL, NULL, homekit_server->verify_pending ? &verify_pending_timeout : &timeout);
+#else
         triggered_nfds = select(homekit_server->max_fd + 1, &read_fds, NULL, NULL, &timeout);
+#endif
         if (triggered_nfds > 0) {
             if (FD_ISSET(homekit_server->listen_fd, &read_fds)) {
                 homekit_server_accept_client();
@@ -3634,6 +3824,12 @@ static void IRAM homekit_run_server() {
             homekit_server_close_clients();
         }
         
+#ifdef HOMEKIT_VERIFY_WORKER
+        if (homekit_server->verify_pending) {
+            homekit_server_process_verify_results();
+        }
+#endif
+        
         if (homekit_server->notifications) {
             homekit_server_process_notifications();
         }
@@ -3816,6 +4012,10 @@ void homekit_server_init(homekit_server_config_t *config) {
         HOMEKIT_INFO("HK ID: %s", homekit_server->accessory_id);
     }
     
+    if (homekit_server->accessory_key) {
+        homekit_server->accessory_expanded_key = crypto_ed25519_expand_key(homekit_server->accessory_key);
+    }
+    
     if (!homekit_server->config->re_pair) {
         pairing_iterator_t *pairing_it = homekit_storage_pairing_iterator();
         pairing_t *pairing = NULL;
@@ -3833,6 +4033,37 @@ void homekit_server_init(homekit_server_config_t *config) {
         free(pairing_it);
     }
     
+#ifdef HOMEKIT_EPHEMERAL_KEY_POOL
+    homekit_server->ephemeral_keys = xQueueCreate(HOMEKIT_EPHEMERAL_KEY_POOL_SIZE, sizeof(curve25519_key*));
+    
+    if (homekit_server->ephemeral_keys &&
+        xTaskCreate(homekit_ephemeral_key_task, "HKK", EPHEMERAL_KEY_TASK_STACK, NULL, EPHEMERAL_KEY_TASK_PRIORITY, NULL) != pdPASS) {
+        ERROR("New HK Keys");
+        vQueueDelete(homekit_server->ephemeral_keys);
+        homekit_server->ephemeral_keys = NULL;
+    }
+#endif
+    
+#ifdef HOMEKIT_VERIFY_WORKER
+    homekit_server->verify_jobs = xQueueCreate(HOMEKIT_VERIFY_WORKER_QUEUE_SIZE, sizeof(pair_verify_job_t*));
+    homekit_server->verify_results = xQueueCreate(HOMEKIT_VERIFY_WORKER_QUEUE_SIZE, sizeof(pair_verify_job_t*));
+    
+    if (!homekit_server->verify_jobs || !homekit_server->verify_results ||
+        xTaskCreatePinnedToCore(homekit_verify_worker_task, "HKV", HOMEKIT_VERIFY_WORKER_STACK, NULL, SERVER_TASK_PRIORITY, NULL, HOMEKIT_VERIFY_WORKER_CORE) != pdPASS) {
+        ERROR("New HK Verify");
+        // Jobs queue is checked before offloading; verify runs inline
+        if (homekit_server->verify_jobs) {
+            vQueueDelete(homekit_server->verify_jobs);
+            homekit_server->verify_jobs = NULL;
+        }
+        
+        if (homekit_server->verify_results) {
+            vQueueDelete(homekit_server->verify_results);
+            homekit_server->verify_results = NULL;
+        }
+    }
+#endif
+    
     unsigned int server_task_stack = SERVER_TASK_STACK_PAIR;
 
 #ifndef ESP_PLATFORM
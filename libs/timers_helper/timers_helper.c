@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #ifdef ESP_PLATFORM
 
@@ -16,8 +17,21 @@
 
 #include "timers_helper.h"
 
+#ifdef ESP_PLATFORM
+static portMUX_TYPE timers_spinlock = portMUX_INITIALIZER_UNLOCKED;
+#define TIMERS_ENTER_CRITICAL()         taskENTER_CRITICAL(&timers_spinlock)
+#define TIMERS_EXIT_CRITICAL()          taskEXIT_CRITICAL(&timers_spinlock)
+#else
+#define TIMERS_ENTER_CRITICAL()         taskENTER_CRITICAL()
+#define TIMERS_EXIT_CRITICAL()          taskEXIT_CRITICAL()
+#endif
+
 #define XTIMER_MAX_TRIES                (5)
 
+#define TIMER_POOL_NONE                 (UINT16_MAX)
+#define TIMER_POOL_MAX_PERIOD_MS        (1000)  // Pool timer auto-reloads at most this late, so a lost command is retried
+#define TIMER_POOL_EXPIRED(tick, now)   ((int32_t) ((now) - (tick)) >= 0)
+
 BaseType_t rs_esp_timer_manager(const uint8_t option, TimerHandle_t xTimer, TickType_t xBlockTime) {
     if (xTimer) {
         switch (option) {
@@ -114,3 +128,468 @@ BaseType_t IRAM rs_esp_timer_start_from_ISR(TimerHandle_t xTimer) {
 BaseType_t IRAM rs_esp_timer_stop_from_ISR(TimerHandle_t xTimer) {
     return rs_esp_timer_manager_from_ISR(TIMER_MANAGER_STOP, xTimer);
 }
+
+// One-shot timer pool
+typedef struct _timer_pool_entry {
+    TickType_t expiry;
+    rs_timer_callback_t callback;
+    void* args;
+    uint16_t seq;               // 0 when free
+    uint16_t next;              // Armed list sorted by expiry, or free list
+} timer_pool_entry_t;
+
+static struct {
+    timer_pool_entry_t* entries;
+    TimerHandle_t timer;
+    uint16_t size;
+    uint16_t first_armed;
+    uint16_t first_free;
+    uint16_t last_seq;
+    bool schedule_failed;       // Timer command queue was full, next arm must schedule again
+    uint32_t schedule_seq;
+} timer_pool = {
+    .first_armed = TIMER_POOL_NONE,
+    .first_free = TIMER_POOL_NONE,
+};
+
+static inline uint32_t timer_pool_id(const uint16_t index) {
+    return ((uint32_t) timer_pool.entries[index].seq << 16) | index;
+}
+
+// Must be called inside critical section
+static timer_pool_entry_t* timer_pool_entry(const uint32_t timer_id) {
+    const uint16_t index = timer_id & 0xFFFF;
+    if (index < timer_pool.size && timer_pool.entries[index].seq != 0 && timer_pool_id(index) == timer_id) {
+        return &timer_pool.entries[index];
+    }
+    
+    return NULL;
+}
+
+// Must be called inside critical section. Same expiry keeps arming order
+static void timer_pool_insert(const uint16_t index) {
+    const TickType_t expiry = timer_pool.entries[index].expiry;
+    uint16_t* link = &timer_pool.first_armed;
+    while (*link != TIMER_POOL_NONE && (int32_t) (timer_pool.entries[*link].expiry - expiry) <= 0) {
+        link = &timer_pool.entries[*link].next;
+    }
+    
+    timer_pool.entries[index].next = *link;
+    *link = index;
+}
+
+// Must be called inside critical section
+static void timer_pool_unlink(const uint16_t index) {
+    uint16_t* link = &timer_pool.first_armed;
+    while (*link != index) {
+        link = &timer_pool.entries[*link].next;
+    }
+    
+    *link = timer_pool.entries[index].next;
+}
+
+// Points FreeRTOS timer to first expiry. Repeated if armed list changed while sending command,
+// so last command always matches current first timer.
+// Commands are not blocking, because this runs in timer service task too. If one is lost, pool
+// timer keeps auto-reloading with a period not longer than TIMER_POOL_MAX_PERIOD_MS, and it
+// schedules again when it fires.
+static void timer_pool_schedule() {
+    for (;;) {
+        TIMERS_ENTER_CRITICAL();
+        const uint32_t schedule_seq = ++timer_pool.schedule_seq;
+        const uint16_t first = timer_pool.first_armed;
+        const TickType_t expiry = first != TIMER_POOL_NONE ? timer_pool.entries[first].expiry : 0;
+        TIMERS_EXIT_CRITICAL();
+        
+        BaseType_t result;
+        if (first == TIMER_POOL_NONE) {
+            result = xTimerStop(timer_pool.timer, 0);
+        } else {
+            const TickType_t now = xTaskGetTickCount();
+            TickType_t delay = 1;
+            if (!TIMER_POOL_EXPIRED(expiry, now)) {
+                delay = expiry - now;
+            }
+            
+            if (delay > TIMER_POOL_MAX_PERIOD_MS / portTICK_PERIOD_MS) {
+                delay = TIMER_POOL_MAX_PERIOD_MS / portTICK_PERIOD_MS;
+            }
+            
+            result = xTimerChangePeriod(timer_pool.timer, delay, 0);
+        }
+        
+        TIMERS_ENTER_CRITICAL();
+        const bool done = (schedule_seq == timer_pool.schedule_seq);
+        if (done) {
+            timer_pool.schedule_failed = (result != pdPASS);
+        }
+        TIMERS_EXIT_CRITICAL();
+        
+        if (done) {
+            break;
+        }
+    }
+}
+
+// Runs all expired timers in expiry order
+static void timer_pool_run(TimerHandle_t xTimer) {
+    for (;;) {
+        rs_timer_callback_t callback = NULL;
+        void* args = NULL;
+        
+        TIMERS_ENTER_CRITICAL();
+        const uint16_t first = timer_pool.first_armed;
+        if (first != TIMER_POOL_NONE && TIMER_POOL_EXPIRED(timer_pool.entries[first].expiry, xTaskGetTickCount())) {
+            timer_pool_entry_t* entry = &timer_pool.entries[first];
+            callback = entry->callback;
+            args = entry->args;
+            
+            timer_pool.first_armed = entry->next;
+            entry->seq = 0;
+            entry->next = timer_pool.first_free;
+            timer_pool.first_free = first;
+        }
+        TIMERS_EXIT_CRITICAL();
+        
+        if (!callback) {
+            break;
+        }
+        
+        callback(args);
+    }
+    
+    timer_pool_schedule();
+}
+
+static inline TickType_t timer_pool_ticks(const uint32_t period_ms) {
+    const TickType_t ticks = period_ms / portTICK_PERIOD_MS;
+    return ticks > 0 ? ticks : 1;
+}
+
+bool rs_timer_pool_init(const uint16_t size) {
+    if (timer_pool.entries || size == 0 || size == TIMER_POOL_NONE) {
+        return false;
+    }
+    
+    timer_pool_entry_t* entries = calloc(size, sizeof(timer_pool_entry_t));
+    if (!entries) {
+        return false;
+    }
+    
+    timer_pool.timer = xTimerCreate(NULL, 1, pdTRUE, NULL, timer_pool_run);
+    if (!timer_pool.timer) {
+        free(entries);
+        return false;
+    }
+    
+    for (unsigned int i = 0; i < size; i++) {
+        entries[i].next = (i + 1 < size) ? i + 1 : TIMER_POOL_NONE;
+    }
+    
+    timer_pool.first_free = 0;
+    timer_pool.size = size;
+    timer_pool.entries = entries;
+    
+    return true;
+}
+
+uint32_t rs_timer_pool_arm(const uint32_t period_ms, rs_timer_callback_t callback, void* args) {
+    if (!timer_pool.entries) {
+        return 0;
+    }
+    
+    const TickType_t expiry = xTaskGetTickCount() + timer_pool_ticks(period_ms);
+    
+    TIMERS_ENTER_CRITICAL();
+    const uint16_t index = timer_pool.first_free;
+    if (index == TIMER_POOL_NONE) {
+        TIMERS_EXIT_CRITICAL();
+        return 0;
+    }
+    
+    timer_pool_entry_t* entry = &timer_pool.entries[index];
+    timer_pool.first_free = entry->next;
+    
+    timer_pool.last_seq++;
+    if (timer_pool.last_seq == 0) {
+        timer_pool.last_seq = 1;
+    }
+    
+    entry->seq = timer_pool.last_seq;
+    entry->expiry = expiry;
+    entry->callback = callback;
+    entry->args = args;
+    timer_pool_insert(index);
+    
+    const uint32_t timer_id = timer_pool_id(index);
+    const bool reschedule = (timer_pool.first_armed == index) || timer_pool.schedule_failed;
+    TIMERS_EXIT_CRITICAL();
+    
+    if (reschedule) {
+        timer_pool_schedule();
+    }
+    
+    return timer_id;
+}
+
+bool rs_timer_pool_rearm(const uint32_t timer_id, const uint32_t period_ms) {
+    const TickType_t expiry = xTaskGetTickCount() + timer_pool_ticks(period_ms);
+    
+    TIMERS_ENTER_CRITICAL();
+    timer_pool_entry_t* entry = timer_pool.entries ? timer_pool_entry(timer_id) : NULL;
+    if (!entry) {
+        TIMERS_EXIT_CRITICAL();
+        return false;
+    }
+    
+    const uint16_t index = entry - timer_pool.entries;
+    const bool was_first = (timer_pool.first_armed == index);
+    timer_pool_unlink(index);
+    entry->expiry = expiry;
+    timer_pool_insert(index);
+    const bool reschedule = was_first || (timer_pool.first_armed == index) || timer_pool.schedule_failed;
+    TIMERS_EXIT_CRITICAL();
+    
+    if (reschedule) {
+        timer_pool_schedule();
+    }
+    
+    return true;
+}
+
+bool rs_timer_pool_cancel(const uint32_t timer_id) {
+    TIMERS_ENTER_CRITICAL();
+    timer_pool_entry_t* entry = timer_pool.entries ? timer_pool_entry(timer_id) : NULL;
+    if (!entry) {
+        TIMERS_EXIT_CRITICAL();
+        return false;
+    }
+    
+    const uint16_t index = entry - timer_pool.entries;
+    const bool was_first = (timer_pool.first_armed == index);
+    timer_pool_unlink(index);
+    entry->seq = 0;
+    entry->next = timer_pool.first_free;
+    timer_pool.first_free = index;
+    TIMERS_EXIT_CRITICAL();
+    
+    if (was_first) {
+        timer_pool_schedule();
+    }
+    
+    return true;
+}
+
+// Hierarchical timer wheel
+// Level 0 slots are one wheel tick wide, each next level is TIMER_WHEEL_SLOTS times wider.
+// Timers beyond wheel range wait in last level and are reinserted when cascaded.
+#define TIMER_WHEEL_SLOT_BITS           (4)
+#define TIMER_WHEEL_SLOTS               (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK           (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS              (4)
+#define TIMER_WHEEL_RANGE               (1 << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+static struct {
+    rs_wheel_timer_t* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    TimerHandle_t timer;
+    TickType_t resolution;          // FreeRTOS ticks by wheel tick
+    TickType_t last_tick;
+    uint32_t now;                   // Next wheel tick to run
+} *timer_wheel = NULL;
+
+// Must be called inside critical section
+static void timer_wheel_link(rs_wheel_timer_t** head, rs_wheel_timer_t* timer) {
+    timer->next = *head;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    
+    timer->pprev = head;
+    *head = timer;
+}
+
+// Must be called inside critical section
+static void timer_wheel_unlink(rs_wheel_timer_t* timer) {
+    if (timer->pprev) {
+        *timer->pprev = timer->next;
+        if (timer->next) {
+            timer->next->pprev = timer->pprev;
+        }
+        
+        timer->pprev = NULL;
+    }
+}
+
+// Must be called inside critical section
+static void timer_wheel_insert(rs_wheel_timer_t* timer) {
+    uint32_t expiry = timer->expiry;
+    int32_t delta = expiry - timer_wheel->now;
+    
+    if (delta < 0) {
+        expiry = timer_wheel->now;
+        delta = 0;
+    } else if (delta >= TIMER_WHEEL_RANGE) {
+        expiry = timer_wheel->now + TIMER_WHEEL_RANGE - 1;
+        delta = TIMER_WHEEL_RANGE - 1;
+    }
+    
+    unsigned int level = 0;
+    while (delta >= (1 << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    
+    timer_wheel_link(&timer_wheel->slots[level][(expiry >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK], timer);
+}
+
+// Runs one wheel tick. Expired timers of slot are run in a batch
+static void timer_wheel_step() {
+    TIMERS_ENTER_CRITICAL();
+    
+    const uint32_t now = timer_wheel->now;
+    const unsigned int index = now & TIMER_WHEEL_SLOT_MASK;
+    
+    // Moves next slot of upper levels down when lower level wraps
+    for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (((now >> (TIMER_WHEEL_SLOT_BITS * (level - 1))) & TIMER_WHEEL_SLOT_MASK) != 0) {
+            break;
+        }
+        
+        rs_wheel_timer_t** slot = &timer_wheel->slots[level][(now >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK];
+        rs_wheel_timer_t* timer = *slot;
+        *slot = NULL;
+        
+        while (timer) {
+            rs_wheel_timer_t* next = timer->next;
+            timer->pprev = NULL;
+            timer_wheel_insert(timer);
+            timer = next;
+        }
+    }
+    
+    rs_wheel_timer_t* expired = timer_wheel->slots[0][index];
+    timer_wheel->slots[0][index] = NULL;
+    if (expired) {
+        expired->pprev = &expired;
+    }
+    
+    timer_wheel->now++;
+    
+    while (expired) {
+        rs_wheel_timer_t* timer = expired;
+        timer_wheel_unlink(timer);
+        
+        if (timer->auto_reload) {
+            timer->expiry += timer->period;
+            if ((int32_t) (timer->expiry - now) <= 0) {
+                timer->expiry = now + timer->period;    // Late, skips missed periods
+            }
+            
+            timer_wheel_insert(timer);
+        }
+        
+        rs_timer_callback_t callback = timer->callback;
+        void* args = timer->args;
+        
+        TIMERS_EXIT_CRITICAL();
+        
+        callback(args);
+        
+        TIMERS_ENTER_CRITICAL();
+    }
+    
+    TIMERS_EXIT_CRITICAL();
+}
+
+static void timer_wheel_run(TimerHandle_t xTimer) {
+    const TickType_t now = xTaskGetTickCount();
+    while ((TickType_t) (now - timer_wheel->last_tick) >= timer_wheel->resolution) {
+        timer_wheel->last_tick += timer_wheel->resolution;
+        timer_wheel_step();
+    }
+}
+
+static inline uint32_t timer_wheel_ticks(const uint32_t period_ms) {
+    const uint32_t ticks = (period_ms / portTICK_PERIOD_MS) / timer_wheel->resolution;
+    return ticks > 0 ? ticks : 1;
+}
+
+bool rs_timer_wheel_init(const uint32_t resolution_ms) {
+    if (timer_wheel) {
+        return false;
+    }
+    
+    TickType_t resolution = resolution_ms / portTICK_PERIOD_MS;
+    if (resolution == 0) {
+        resolution = 1;
+    }
+    
+    timer_wheel = calloc(1, sizeof(*timer_wheel));
+    if (!timer_wheel) {
+        return false;
+    }
+    
+    timer_wheel->resolution = resolution;
+    timer_wheel->timer = xTimerCreate(NULL, resolution, pdTRUE, NULL, timer_wheel_run);
+    if (!timer_wheel->timer) {
+        free(timer_wheel);
+        timer_wheel = NULL;
+        return false;
+    }
+    
+    timer_wheel->last_tick = xTaskGetTickCount();
+    xTimerStart(timer_wheel->timer, portMAX_DELAY);
+    
+    return true;
+}
+
+rs_wheel_timer_t* rs_wheel_timer_create(const uint32_t period_ms, const bool auto_reload, void* args, rs_timer_callback_t callback) {
+    if (!timer_wheel) {
+        return NULL;
+    }
+    
+    rs_wheel_timer_t* timer = calloc(1, sizeof(rs_wheel_timer_t));
+    if (timer) {
+        timer->period = timer_wheel_ticks(period_ms);
+        timer->auto_reload = auto_reload;
+        timer->callback = callback;
+        timer->args = args;
+    }
+    
+    return timer;
+}
+
+static void timer_wheel_start(rs_wheel_timer_t* timer, const uint32_t delay) {
+    TIMERS_ENTER_CRITICAL();
+    timer_wheel_unlink(timer);
+    timer->expiry = timer_wheel->now + delay - 1;  // Current wheel tick is partially elapsed
+    timer_wheel_insert(timer);
+    TIMERS_EXIT_CRITICAL();
+}
+
+void rs_wheel_timer_start(rs_wheel_timer_t* timer) {
+    if (timer) {
+        timer_wheel_start(timer, timer->period);
+    }
+}
+
+void rs_wheel_timer_start_in(rs_wheel_timer_t* timer, const uint32_t delay_ms) {
+    if (timer) {
+        timer_wheel_start(timer, timer_wheel_ticks(delay_ms));
+    }
+}
+
+void rs_wheel_timer_stop(rs_wheel_timer_t* timer) {
+    if (timer) {
+        TIMERS_ENTER_CRITICAL();
+        timer_wheel_unlink(timer);
+        TIMERS_EXIT_CRITICAL();
+    }
+}
+
+// Like xTimerChangePeriod(), also starts timer
+void rs_wheel_timer_change_period(rs_wheel_timer_t* timer, const uint32_t period_ms) {
+    if (timer) {
+        timer->period = timer_wheel_ticks(period_ms);
+        timer_wheel_start(timer, timer->period);
+    }
+}
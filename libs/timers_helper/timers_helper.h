@@ -25,6 +25,7 @@ extern "C" {
 
 #endif
 
+#include <stdbool.h>
 
 #define TIMER_MANAGER_START                                     (0)
 #define TIMER_MANAGER_STOP                                      (1)
@@ -49,6 +50,39 @@ BaseType_t rs_esp_timer_manager_from_ISR(const uint8_t option, TimerHandle_t xTi
 
 TimerHandle_t rs_esp_timer_create(const uint32_t period_ms, const UBaseType_t auto_reload, void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction);
 
+typedef void (*rs_timer_callback_t)(void* args);
+
+// One-shot timer pool
+// Preallocated one-shot timers sharing a single FreeRTOS timer. Callbacks run in timer service task.
+// Timer ID 0 means no free timer.
+bool rs_timer_pool_init(const uint16_t size);
+uint32_t rs_timer_pool_arm(const uint32_t period_ms, rs_timer_callback_t callback, void* args);
+bool rs_timer_pool_rearm(const uint32_t timer_id, const uint32_t period_ms);
+bool rs_timer_pool_cancel(const uint32_t timer_id);
+
+// Hierarchical timer wheel
+// Timers driven by a single FreeRTOS timer ticking every resolution_ms, with O(1) start and stop.
+// Callbacks run in timer service task.
+typedef struct _rs_wheel_timer {
+    struct _rs_wheel_timer* next;
+    struct _rs_wheel_timer** pprev;     // NULL when stopped
+    
+    uint32_t expiry;                    // Wheel ticks
+    uint32_t period;                    // Wheel ticks
+    
+    rs_timer_callback_t callback;
+    void* args;
+    
+    bool auto_reload;
+} rs_wheel_timer_t;
+
+bool rs_timer_wheel_init(const uint32_t resolution_ms);
+rs_wheel_timer_t* rs_wheel_timer_create(const uint32_t period_ms, const bool auto_reload, void* args, rs_timer_callback_t callback);
+void rs_wheel_timer_start(rs_wheel_timer_t* timer);
+void rs_wheel_timer_start_in(rs_wheel_timer_t* timer, const uint32_t delay_ms);
+void rs_wheel_timer_stop(rs_wheel_timer_t* timer);
+void rs_wheel_timer_change_period(rs_wheel_timer_t* timer, const uint32_t period_ms);
+
 #ifdef __cplusplus
 }
 #endif
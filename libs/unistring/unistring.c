@@ -15,11 +15,49 @@
 
 #include "unistring.h"
 
-unsigned char* uni_memdup(unsigned char* string, size_t size, unistring_t** unistrings) {
-    unistring_t* unistring = *unistrings;
+// FNV-1a
+static uint32_t unistring_hash(const unsigned char* string, const size_t size) {
+    uint32_t hash = 2166136261;
+    
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ string[i]) * 16777619;
+    }
+    
+    return hash;
+}
+
+void unistring_init(unistrings_t* unistrings, const unsigned int expected) {
+    memset(unistrings, 0, sizeof(unistrings_t));
+    
+    unsigned int bucket_count = UNISTRING_BUCKETS_MIN;
+    while ((bucket_count << 1) < expected && bucket_count < UNISTRING_BUCKETS_MAX) {
+        bucket_count <<= 1;
+    }
+    
+    unistrings->buckets = calloc(bucket_count, sizeof(unistring_t*));
+    if (unistrings->buckets) {
+        unistrings->bucket_count = bucket_count;
+    }
+}
+
+unsigned char* uni_memdup(unsigned char* string, size_t size, unistrings_t* unistrings) {
+    if (!unistrings->buckets) {
+        unistring_init(unistrings, 0);
+        
+        if (!unistrings->buckets) {
+            unsigned char* new_string = malloc(size);
+            memcpy(new_string, string, size);
+            return new_string;
+        }
+    }
+    
+    const uint32_t hash = unistring_hash(string, size);
+    unistring_t** bucket = &unistrings->buckets[hash & (unistrings->bucket_count - 1)];
+    unistring_t* unistring = *bucket;
     
     while (unistring &&
-           (size != unistring->size ||
+           (hash != unistring->hash ||
+           size != unistring->size ||
            memcmp(string, unistring->string, size))) {
         unistring = unistring->next;
     }
@@ -28,34 +66,46 @@ unsigned char* uni_memdup(unsigned char* string, size_t size, unistring_t** unis
         unistring = calloc(1, sizeof(unistring_t));
         
         unistring->size = size;
+        unistring->hash = hash;
         unistring->string = malloc(size);
         memcpy(unistring->string, string, size);
         
-        unistring->next = *unistrings;
-        *unistrings = unistring;
+        unistring->next = *bucket;
+        *bucket = unistring;
+        
+        unistrings->count++;
+    } else {
+        unistrings->dup_count++;
+        unistrings->saved_bytes += size;
     }
     
     return unistring->string;
 }
 
-char* uni_strdup(char* string, unistring_t** unistrings) {
+char* uni_strdup(char* string, unistrings_t* unistrings) {
     return (char*) uni_memdup((unsigned char*) string, strlen(string) + 1, unistrings);
 }
 
-void unistring_destroy(unistring_t* unistrings) {
-    unistring_t* unistring = unistrings;
-    
-    while (unistring) {
-        unistring_t* current_unistring = unistring;
-        unistring = unistring->next;
+void unistring_destroy(unistrings_t* unistrings) {
+    for (unsigned int i = 0; i < unistrings->bucket_count; i++) {
+        unistring_t* unistring = unistrings->buckets[i];
         
+        while (unistring) {
+            unistring_t* current_unistring = unistring;
+            unistring = unistring->next;
+            
 #ifdef UNISTRING_DEBUG
-        char* str = malloc(current_unistring->size + 1);
-        snprintf(str, current_unistring->size, "%s", current_unistring->string);
-        printf("UNIString (%i): \"%s\"\n", current_unistring->size, str);
-        free(str);
+            char* str = malloc(current_unistring->size + 1);
+            snprintf(str, current_unistring->size, "%s", current_unistring->string);
+            printf("UNIString (%i): \"%s\"\n", current_unistring->size, str);
+            free(str);
 #endif
-        
-        free(current_unistring);
+            
+            free(current_unistring);
+        }
     }
+    
+    free(unistrings->buckets);
+    unistrings->buckets = NULL;
+    unistrings->bucket_count = 0;
 }
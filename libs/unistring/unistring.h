@@ -12,16 +12,35 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stddef.h>
+
+#define UNISTRING_BUCKETS_MIN       (8)
+#define UNISTRING_BUCKETS_MAX       (256)
+
 typedef struct _unistring {
     size_t size;
+    uint32_t hash;
     unsigned char* string;
     
     struct _unistring* next;
 } unistring_t;
 
-unsigned char* uni_memdup(unsigned char* string, size_t size, unistring_t** unistrings);
-char* uni_strdup(char* string, unistring_t** unistrings);
-void unistring_destroy(unistring_t* unistrings);
+typedef struct _unistrings {
+    unistring_t** buckets;
+    uint16_t bucket_count;
+    
+    uint16_t count;
+    uint16_t dup_count;
+    uint32_t saved_bytes;
+} unistrings_t;
+
+// Sizes hash table for about expected strings, two per bucket. Optional, first uni_memdup() uses UNISTRING_BUCKETS_MIN
+void unistring_init(unistrings_t* unistrings, const unsigned int expected);
+unsigned char* uni_memdup(unsigned char* string, size_t size, unistrings_t* unistrings);
+char* uni_strdup(char* string, unistrings_t* unistrings);
+// Frees hash table and entries. Interned strings are kept
+void unistring_destroy(unistrings_t* unistrings);
 
 #ifdef __cplusplus
 }
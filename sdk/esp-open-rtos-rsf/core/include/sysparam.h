@@ -60,6 +60,17 @@ typedef struct {
     struct sysparam_context *ctx;
 } sysparam_iter_t;
 
+/** One key/value pair to be written by sysparam_set_batch()
+ *
+ *  `value` and `value_len` have the same meaning as in sysparam_set_data().
+ */
+typedef struct {
+    const char *key;
+    const uint8_t *value;
+    size_t value_len;
+    bool binary;
+} sysparam_batch_item_t;
+
 /** Initialize sysparam and set up the current area of flash to use.
  *
  *  This must be called (and return successfully) before any other sysparam
@@ -138,6 +149,21 @@ sysparam_status_t sysparam_create_area(uint32_t base_addr, uint16_t num_sectors,
  */
 sysparam_status_t sysparam_get_info(uint32_t *base_addr, uint32_t *num_sectors);
 
+/** Get the space available for new entries in the sysparam area.
+ *
+ *  This includes the space taken up by deleted values, which is recovered
+ *  by compacting the area when a write needs it. Keys left without a value
+ *  are not counted, so a write can find some more space than reported.
+ *
+ *  @param[out] free_space  Number of bytes available for new entries, each
+ *                          one taking a 4 byte header plus its payload
+ *
+ *  @retval ::SYSPARAM_OK           Completed successfully
+ *  @retval ::SYSPARAM_ERR_NOINIT   No current sysparam area is active
+ *  @retval ::SYSPARAM_ERR_IO       I/O error reading flash
+ */
+sysparam_status_t sysparam_get_free(size_t *free_space);
+
 /** Compact the sysparam area.
  *
  *  This also flattens the log.
@@ -423,6 +449,33 @@ sysparam_status_t sysparam_set_int8(const char *key, int8_t value);
  */
 sysparam_status_t sysparam_set_bool(const char *key, bool value);
 
+/** Set the values of several keys at once
+ *
+ *  Performs the same function as calling sysparam_set_data() for each item,
+ *  but takes the lock once, compares all items with their current values
+ *  before writing anything, checks free space (compacting at most once) for
+ *  all changed items together and appends them in a single pass.  Items whose
+ *  stored value already matches are not written at all.
+ *
+ *  Each key must appear only once in `items`.
+ *
+ *  @param[in]  items    Array of key/value pairs to set
+ *  @param[in]  count    Number of items in `items`
+ *  @param[out] written  If not NULL, set to the number of bytes written to
+ *                       flash (entry headers included)
+ *
+ *  @retval ::SYSPARAM_OK           All values successfully set.
+ *  @retval ::SYSPARAM_ERR_NOINIT   sysparam_init() must be called first
+ *  @retval ::SYSPARAM_ERR_BADVALUE Either an empty key was provided or a
+ *                                  value_len is too large
+ *  @retval ::SYSPARAM_ERR_FULL     No space left in sysparam area
+ *                                  (or too many keys in use)
+ *  @retval ::SYSPARAM_ERR_NOMEM    Unable to allocate memory
+ *  @retval ::SYSPARAM_ERR_CORRUPT  Sysparam region has bad/corrupted data
+ *  @retval ::SYSPARAM_ERR_IO       I/O error reading/writing flash
+ */
+sysparam_status_t sysparam_set_batch(const sysparam_batch_item_t *items, size_t count, size_t *written);
+
 /** Begin iterating through all key/value pairs
  *
  *  This function initializes a sysparam_iter_t structure to prepare it for
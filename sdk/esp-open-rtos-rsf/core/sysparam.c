@@ -75,6 +75,15 @@
 #define SYSPARAM_DEBUG 0
 #endif
 
+/* Set to 1 to keep an in-RAM directory of key hash -> key and value entry
+ * addresses, built once at `sysparam_init` and kept up to date on every write
+ * and compaction.  Lookups then read only the matching entries from flash
+ * instead of scanning the whole region.  Costs 8 bytes of RAM per key.
+ */
+#ifndef SYSPARAM_INDEX
+#define SYSPARAM_INDEX 0
+#endif
+
 /******************************* Useful Macros *******************************/
 
 #define ROUND_TO_WORD_BOUNDARY(x) (((x) + 3) & 0xfffffffc)
@@ -121,6 +130,25 @@ struct {
     SemaphoreHandle_t sem;
 } _sysparam_info;
 
+#if SYSPARAM_INDEX
+/* Offsets are relative to `cur_base`, so region must be smaller than 64KB.
+ * A value_offset of 0 means that key has no value.
+ */
+struct index_entry {
+    uint16_t hash;
+    uint16_t key_id;
+    uint16_t key_offset;
+    uint16_t value_offset;
+};
+
+struct {
+    struct index_entry *entries;    // Sorted by hash
+    uint16_t count;
+    uint16_t capacity;
+    uint16_t max_key_id;
+} _sysparam_index;
+#endif
+
 /***************************** Internal routines *****************************/
 
 static sysparam_status_t _write_and_verify(uint32_t addr, const void *data, size_t data_size) {
@@ -408,6 +436,275 @@ static inline sysparam_status_t _delete_entry(uint32_t addr) {
     return _write_and_verify(addr, &entry, ENTRY_HEADER_SIZE);
 }
 
+#if SYSPARAM_INDEX
+/******************************* Index routines ******************************/
+
+static inline uint16_t _index_hash_update(uint32_t *hash, const uint8_t *data, size_t len) {
+    // FNV-1a, folded to 16 bits
+    for (size_t i = 0; i < len; i++) {
+        *hash = (*hash ^ data[i]) * 16777619;
+    }
+    return (uint16_t) ((*hash >> 16) ^ *hash);
+}
+
+static inline uint16_t _index_hash(const char *key, uint16_t key_len) {
+    uint32_t hash = 2166136261;
+    return _index_hash_update(&hash, (const uint8_t *) key, key_len);
+}
+
+static void _index_free() {
+    if (_sysparam_index.entries) {
+        free(_sysparam_index.entries);
+    }
+    memset(&_sysparam_index, 0, sizeof(_sysparam_index));
+}
+
+/** First position with hash >= `hash` */
+static uint16_t _index_lower_bound(uint16_t hash) {
+    uint16_t low = 0;
+    uint16_t high = _sysparam_index.count;
+    while (low < high) {
+        uint16_t mid = (low + high) >> 1;
+        if (_sysparam_index.entries[mid].hash < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static bool _index_reserve(uint16_t count) {
+    if (count > _sysparam_index.capacity) {
+        uint16_t capacity = max(count, _sysparam_index.capacity + 16);
+        struct index_entry *entries = realloc(_sysparam_index.entries, capacity * sizeof(struct index_entry));
+        if (!entries) {
+            return false;
+        }
+        _sysparam_index.entries = entries;
+        _sysparam_index.capacity = capacity;
+    }
+    return true;
+}
+
+static int _index_compare(const void *a, const void *b) {
+    return (int) ((const struct index_entry *) a)->hash - (int) ((const struct index_entry *) b)->hash;
+}
+
+/** Scan the active region once and build the directory.  On any failure the
+ *  index is dropped and lookups fall back to scanning flash.
+ */
+static sysparam_status_t _index_build() {
+    struct entry_header entry;
+    uint8_t bounce[BOUNCE_BUFFER_SIZE];
+    uint32_t addr = _sysparam_info.cur_base + REGION_HEADER_SIZE;
+    uint16_t id;
+
+    _index_free();
+
+    if (_sysparam_info.region_size > 0x10000) {
+        debug(1, "region too big for index");
+        return SYSPARAM_ERR_BADVALUE;
+    }
+
+    while (addr + ENTRY_HEADER_SIZE <= _sysparam_info.end_addr) {
+        if (!spiflash_read(addr, (void*) &entry, ENTRY_HEADER_SIZE)) {
+            _index_free();
+            return SYSPARAM_ERR_IO;
+        }
+
+        if ((entry.idflags & (ENTRY_FLAG_ALIVE | ENTRY_FLAG_INVALID)) == ENTRY_FLAG_ALIVE) {
+            id = entry.idflags & ENTRY_MASK_ID;
+            if (!(entry.idflags & ENTRY_FLAG_VALUE)) {
+                // Key ids are assigned in increasing order, so entries are
+                // sorted by id while building.
+                if (id <= _sysparam_index.max_key_id) {
+                    debug(1, "unordered key id 0x%03x, index disabled", id);
+                    _index_free();
+                    return SYSPARAM_ERR_BADVALUE;
+                }
+                if (!_index_reserve(_sysparam_index.count + 1)) {
+                    _index_free();
+                    return SYSPARAM_ERR_NOMEM;
+                }
+
+                uint32_t hash = 2166136261;
+                uint16_t hash16 = (uint16_t) ((hash >> 16) ^ hash);
+                for (size_t i = 0; i < entry.len; i += BOUNCE_BUFFER_SIZE) {
+                    size_t len = min(entry.len - i, BOUNCE_BUFFER_SIZE);
+                    if (!spiflash_read(addr + ENTRY_HEADER_SIZE + i, bounce, len)) {
+                        _index_free();
+                        return SYSPARAM_ERR_IO;
+                    }
+                    hash16 = _index_hash_update(&hash, bounce, len);
+                }
+
+                struct index_entry *index_entry = &_sysparam_index.entries[_sysparam_index.count++];
+                index_entry->hash = hash16;
+                index_entry->key_id = id;
+                index_entry->key_offset = addr - _sysparam_info.cur_base;
+                index_entry->value_offset = 0;
+                _sysparam_index.max_key_id = id;
+            } else {
+                uint16_t low = 0;
+                uint16_t high = _sysparam_index.count;
+                while (low < high) {
+                    uint16_t mid = (low + high) >> 1;
+                    if (_sysparam_index.entries[mid].key_id < id) {
+                        low = mid + 1;
+                    } else {
+                        high = mid;
+                    }
+                }
+                if (low < _sysparam_index.count && _sysparam_index.entries[low].key_id == id) {
+                    _sysparam_index.entries[low].value_offset = addr - _sysparam_info.cur_base;
+                }
+            }
+        }
+
+        addr += ENTRY_SIZE(entry.len);
+    }
+
+    if (!_sysparam_index.entries && !_index_reserve(16)) {
+        return SYSPARAM_ERR_NOMEM;
+    }
+
+    qsort(_sysparam_index.entries, _sysparam_index.count, sizeof(struct index_entry), _index_compare);
+
+    debug(2, "index built (%d keys)", _sysparam_index.count);
+
+    return SYSPARAM_OK;
+}
+
+/** Find the index entry for `key`, leaving `ctx` pointing to its key entry */
+static sysparam_status_t _index_find_key(struct sysparam_context *ctx, const char *key, uint16_t key_len, struct index_entry **result) {
+    sysparam_status_t status;
+    uint16_t hash = _index_hash(key, key_len);
+
+    for (uint16_t i = _index_lower_bound(hash); i < _sysparam_index.count && _sysparam_index.entries[i].hash == hash; i++) {
+        ctx->addr = _sysparam_info.cur_base + _sysparam_index.entries[i].key_offset;
+        CHECK_FLASH_OP(spiflash_read(ctx->addr, (void*) &ctx->entry, ENTRY_HEADER_SIZE));
+        status = _compare_payload(ctx, (uint8_t *)key, key_len);
+        if (status == SYSPARAM_OK) {
+            *result = &_sysparam_index.entries[i];
+            return SYSPARAM_OK;
+        }
+        if (status != SYSPARAM_NOTFOUND) return status;
+    }
+
+    ctx->entry.len = 0;
+    ctx->entry.idflags = 0;
+    return SYSPARAM_NOTFOUND;
+}
+
+/** Point `ctx` to the value entry of an index entry */
+static sysparam_status_t _index_find_value(struct sysparam_context *ctx, const struct index_entry *index_entry) {
+    if (!index_entry->value_offset) {
+        ctx->entry.len = 0;
+        ctx->entry.idflags = 0;
+        return SYSPARAM_NOTFOUND;
+    }
+
+    ctx->addr = _sysparam_info.cur_base + index_entry->value_offset;
+    CHECK_FLASH_OP(spiflash_read(ctx->addr, (void*) &ctx->entry, ENTRY_HEADER_SIZE));
+    return SYSPARAM_OK;
+}
+
+static void _index_add_key(const char *key, uint16_t key_len, uint16_t key_id, uint32_t key_addr) {
+    if (!_index_reserve(_sysparam_index.count + 1)) {
+        _index_free();
+        return;
+    }
+
+    uint16_t hash = _index_hash(key, key_len);
+    uint16_t pos = _index_lower_bound(hash);
+    memmove(&_sysparam_index.entries[pos + 1], &_sysparam_index.entries[pos], (_sysparam_index.count - pos) * sizeof(struct index_entry));
+    _sysparam_index.count++;
+
+    _sysparam_index.entries[pos].hash = hash;
+    _sysparam_index.entries[pos].key_id = key_id;
+    _sysparam_index.entries[pos].key_offset = key_addr - _sysparam_info.cur_base;
+    _sysparam_index.entries[pos].value_offset = 0;
+    _sysparam_index.max_key_id = max(_sysparam_index.max_key_id, key_id);
+}
+
+static void _index_set_value(const char *key, uint16_t key_len, uint16_t key_id, uint32_t value_addr) {
+    uint16_t hash = _index_hash(key, key_len);
+
+    for (uint16_t i = _index_lower_bound(hash); i < _sysparam_index.count && _sysparam_index.entries[i].hash == hash; i++) {
+        if (_sysparam_index.entries[i].key_id == key_id) {
+            _sysparam_index.entries[i].value_offset = value_addr ? value_addr - _sysparam_info.cur_base : 0;
+            return;
+        }
+    }
+
+    // Should never happen, but index can not be trusted anymore
+    _index_free();
+}
+#endif
+
+/** Find the key entry for `key` and its associated value entry, leaving `ctx`
+ *  pointing to the value entry
+ */
+static sysparam_status_t _find_key_value(struct sysparam_context *ctx, const char *key, uint16_t key_len) {
+    sysparam_status_t status;
+
+#if SYSPARAM_INDEX
+    if (_sysparam_index.entries) {
+        struct index_entry *index_entry;
+        status = _index_find_key(ctx, key, key_len, &index_entry);
+        if (status != SYSPARAM_OK) return status;
+        return _index_find_value(ctx, index_entry);
+    }
+#endif
+
+    status = _find_key(ctx, key, key_len);
+    if (status != SYSPARAM_OK) return status;
+    return _find_value(ctx, ctx->entry.idflags);
+}
+
+/** Find the key entry for `key` and its current value entry (if any) before
+ *  updating it.
+ *
+ *  On return `key_id` holds the id of the key (or -1 if there is no such key),
+ *  `old_value_addr` holds the address of the current value (or 0 if there is
+ *  none) and `ctx` points to that value entry.
+ */
+static sysparam_status_t _find_key_for_update(struct sysparam_context *ctx, const char *key, uint16_t key_len, int *key_id, uint32_t *old_value_addr) {
+    sysparam_status_t status;
+
+    *key_id = -1;
+    *old_value_addr = 0;
+
+#if SYSPARAM_INDEX
+    if (_sysparam_index.entries) {
+        struct index_entry *index_entry;
+        status = _index_find_key(ctx, key, key_len, &index_entry);
+        if (status == SYSPARAM_OK) {
+            *key_id = ctx->entry.idflags & ENTRY_MASK_ID;
+            status = _index_find_value(ctx, index_entry);
+            if (status == SYSPARAM_OK) {
+                *old_value_addr = ctx->addr;
+            }
+        } else {
+            ctx->max_key_id = _sysparam_index.max_key_id;
+        }
+        return status;
+    }
+#endif
+
+    status = _find_key(ctx, key, key_len);
+    if (status == SYSPARAM_OK) {
+        // Key already exists, see if there's a current value.
+        *key_id = ctx->entry.idflags & ENTRY_MASK_ID;
+        status = _find_value(ctx, *key_id);
+        if (status == SYSPARAM_OK) {
+            *old_value_addr = ctx->addr;
+        }
+    }
+    return status;
+}
+
 /** Compact the current region, removing all deleted/unused entries, and write
  *  the result to the alternate region, then make the new alternate region the
  *  active one.
@@ -486,6 +783,10 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
     _sysparam_info.end_addr = addr;
     _sysparam_info.force_compact = false;
 
+#if SYSPARAM_INDEX
+    _index_build();
+#endif
+
     if (ctx) {
         // Fix up ctx so it doesn't point to invalid stuff
         memset(ctx, 0, sizeof(*ctx));
@@ -588,6 +889,10 @@ sysparam_status_t sysparam_init(uint32_t base_addr, uint32_t top_addr) {
         _sysparam_info.end_addr = ctx.addr;
     }
 
+#if SYSPARAM_INDEX
+    _index_build();
+#endif
+
     return SYSPARAM_OK;
 }
 
@@ -625,6 +930,9 @@ sysparam_status_t sysparam_create_area(uint32_t base_addr, uint16_t num_sectors,
         // De-initialize everything to force the caller to do a clean
         // `sysparam_init()` afterwards.
         memset(&_sysparam_info, 0, sizeof(_sysparam_info));
+#if SYSPARAM_INDEX
+        _index_free();
+#endif
     }
     status = _format_region(base_addr, num_sectors);
     if (status < 0) return status;
@@ -646,6 +954,27 @@ sysparam_status_t sysparam_get_info(uint32_t *base_addr, uint32_t *num_sectors)
     return SYSPARAM_OK;
 }
 
+sysparam_status_t sysparam_get_free(size_t *free_space) {
+    struct sysparam_context ctx;
+    sysparam_status_t status;
+
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+
+    if (_sysparam_info.cur_base) {
+        // Scan to the end to count space taken by deleted entries
+        _init_context(&ctx);
+        status = _find_entry(&ctx, ENTRY_ID_END, false);
+        if (status == SYSPARAM_OK) {
+            *free_space = _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr + ctx.compactable;
+        }
+    } else {
+        status = SYSPARAM_ERR_NOINIT;
+    }
+
+    xSemaphoreGive(_sysparam_info.sem);
+    return status;
+}
+
 sysparam_status_t sysparam_compact() {
     xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
     sysparam_status_t status;
@@ -676,11 +1005,7 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
     }
 
     _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len);
-    if (status != SYSPARAM_OK) goto done;
-
-    // Find the associated value
-    status = _find_value(&ctx, ctx.entry.idflags);
+    status = _find_key_value(&ctx, key, key_len);
     if (status != SYSPARAM_OK) goto done;
 
     buffer = malloc(ctx.entry.len + 1);
@@ -729,9 +1054,7 @@ sysparam_status_t sysparam_get_data_static(const char *key, uint8_t *dest, size_
     }
 
     _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len);
-    if (status != SYSPARAM_OK) goto done;
-    status = _find_value(&ctx, ctx.entry.idflags);
+    status = _find_key_value(&ctx, key, key_len);
     if (status != SYSPARAM_OK) goto done;
     status = _read_payload(&ctx, dest, dest_size);
     if (status != SYSPARAM_OK) goto done;
@@ -873,15 +1196,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
 
     do {
         _init_context(&ctx);
-        status = _find_key(&ctx, key, key_len);
-        if (status == SYSPARAM_OK) {
-            // Key already exists, see if there's a current value.
-            key_id = ctx.entry.idflags & ENTRY_MASK_ID;
-            status = _find_value(&ctx, key_id);
-            if (status == SYSPARAM_OK) {
-                old_value_addr = ctx.addr;
-            }
-        }
+        status = _find_key_for_update(&ctx, key, key_len, &key_id, &old_value_addr);
         if (status < 0) break;
 
         binary_flag = is_binary ? ENTRY_FLAG_BINARY : 0;
@@ -921,6 +1236,15 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // Can we compact things?
                 // First, scan all remaining entries up to the end so we can
                 // get a reasonably accurate "compactable" reading.
+#if SYSPARAM_INDEX
+                if (_sysparam_index.entries) {
+                    // Index lookups did not scan anything, so start from the
+                    // beginning, keeping the old value space already counted.
+                    size_t old_value_space = ctx.compactable;
+                    _init_context(&ctx);
+                    ctx.compactable = old_value_space;
+                }
+#endif
                 _find_entry(&ctx, ENTRY_ID_END, false);
                 if (needed_space <= free_space + ctx.compactable) {
                     // We should be able to get enough space by compacting.
@@ -954,6 +1278,13 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // ctx.max_key_id has the largest key_id found in the whole
                 // region.
                 if (ctx.max_key_id >= MAX_KEY_ID) {
+#if SYSPARAM_INDEX
+                    if (_sysparam_index.entries) {
+                        // Count unused keys
+                        _init_context(&ctx);
+                        _find_entry(&ctx, ENTRY_ID_END, false);
+                    }
+#endif
                     if (ctx.unused_keys > 0) {
                         status = _compact_params(&ctx, &key_id);
                         if (status < 0) break;
@@ -981,12 +1312,22 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 key_id = ctx.max_key_id + 1;
                 status = _write_entry(write_ctx.addr, key_id, (uint8_t *)key, key_len);
                 if (status < 0) break;
+#if SYSPARAM_INDEX
+                if (_sysparam_index.entries) {
+                    _index_add_key(key, key_len, key_id, write_ctx.addr);
+                }
+#endif
                 write_ctx.addr += ENTRY_SIZE(key_len);
             }
 
             // Write new value
             status = _write_entry(write_ctx.addr, key_id | ENTRY_FLAG_VALUE | binary_flag, value, value_len);
             if (status < 0) break;
+#if SYSPARAM_INDEX
+            if (_sysparam_index.entries) {
+                _index_set_value(key, key_len, key_id, write_ctx.addr);
+            }
+#endif
             write_ctx.addr += ENTRY_SIZE(value_len);
             _sysparam_info.end_addr = write_ctx.addr;
         }
@@ -995,11 +1336,23 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
         if (old_value_addr) {
             status = _delete_entry(old_value_addr);
             if (status < 0) break;
+#if SYSPARAM_INDEX
+            if (!value_len && _sysparam_index.entries) {
+                _index_set_value(key, key_len, key_id, 0);
+            }
+#endif
         }
 
         debug(1, "New addr is 0x%08x (%d bytes remaining)", _sysparam_info.end_addr, _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr);
     } while (false);
 
+#if SYSPARAM_INDEX
+    if (status == SYSPARAM_ERR_IO) {
+        // Index can be out of sync with flash, so rebuild it
+        _index_build();
+    }
+#endif
+
  done:
     xSemaphoreGive(_sysparam_info.sem);
 
@@ -1040,6 +1393,204 @@ sysparam_status_t sysparam_set_bool(const char *key, bool value) {
     return sysparam_set_data(key, buf, 1, false);
 }
 
+sysparam_status_t sysparam_set_batch(const sysparam_batch_item_t *items, size_t count, size_t *written) {
+    struct sysparam_context ctx;
+    struct sysparam_context write_ctx;
+    struct batch_state {
+        int key_id;
+        uint32_t old_value_addr;
+        bool changed;
+    } *state;
+    sysparam_status_t status = SYSPARAM_OK;
+    size_t free_space;
+    size_t needed_space;
+    size_t written_bytes = 0;
+    size_t written_items = 0;
+    uint16_t new_keys;
+    uint16_t max_key_id = 0;
+    bool compacted = false;
+    size_t i;
+
+    if (written) *written = 0;
+
+    for (i = 0; i < count; i++) {
+        size_t key_len = strlen(items[i].key);
+        if (!key_len) return SYSPARAM_ERR_BADVALUE;
+#if MAX_KEY_LEN<0xffff
+        if (key_len > MAX_KEY_LEN) return SYSPARAM_ERR_BADVALUE;
+#endif
+        if (items[i].value_len > MAX_VALUE_LEN) return SYSPARAM_ERR_BADVALUE;
+    }
+
+    if (!count) return SYSPARAM_OK;
+
+    state = malloc(count * sizeof(*state));
+    if (!state) return SYSPARAM_ERR_NOMEM;
+
+    debug(1, "updating batch of %d values", count);
+
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+
+    if (!_sysparam_info.cur_base) {
+        status = SYSPARAM_ERR_NOINIT;
+        goto done;
+    }
+
+    do {
+        while (true) {
+            // Compare every item with its current value, so only the changed
+            // ones will be written.
+            needed_space = 0;
+            new_keys = 0;
+            for (i = 0; i < count; i++) {
+                uint16_t key_len = strlen(items[i].key);
+                size_t value_len = items[i].value ? items[i].value_len : 0;
+                uint16_t binary_flag = items[i].binary ? ENTRY_FLAG_BINARY : 0;
+
+                _init_context(&ctx);
+                status = _find_key_for_update(&ctx, items[i].key, key_len, &state[i].key_id, &state[i].old_value_addr);
+                if (status < 0) break;
+                status = SYSPARAM_OK;
+
+                // Erasing a key only changes something if it has a value
+                state[i].changed = (state[i].old_value_addr != 0);
+
+                if (value_len) {
+                    if (state[i].old_value_addr && (ctx.entry.idflags & ENTRY_FLAG_BINARY) == binary_flag) {
+                        status = _compare_payload(&ctx, (uint8_t *) items[i].value, value_len);
+                        if (status < 0) break;
+                        if (status == SYSPARAM_OK) {
+                            state[i].changed = false;
+                            continue;
+                        }
+                        status = SYSPARAM_OK;
+                    }
+
+                    state[i].changed = true;
+                    needed_space += ENTRY_SIZE(value_len);
+                    if (state[i].key_id < 0) {
+                        needed_space += ENTRY_SIZE(key_len);
+                        new_keys++;
+                    }
+                }
+            }
+            if (status < 0) break;
+
+            free_space = _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr;
+            if (!new_keys && needed_space <= free_space && !_sysparam_info.force_compact) {
+                break;
+            }
+
+            // Scan the whole region once to get max key id, unused keys and
+            // compactable space for all items together.
+            _init_context(&ctx);
+            _find_entry(&ctx, ENTRY_ID_END, false);
+            max_key_id = ctx.max_key_id;
+
+            if (compacted) {
+                break;
+            }
+
+            if (_sysparam_info.force_compact ||
+                (needed_space > free_space && (needed_space <= free_space + ctx.compactable || ctx.unused_keys > 0)) ||
+                (max_key_id + new_keys > MAX_KEY_ID && ctx.unused_keys > 0)) {
+                status = _compact_params(&ctx, NULL);
+                if (status < 0) break;
+                compacted = true;
+                // All entries have been moved, so look them up again
+                continue;
+            }
+
+            break;
+        }
+        if (status < 0) break;
+
+        if (needed_space > free_space) {
+            debug(1, "region full (need %d of %d remaining)", needed_space, free_space);
+            status = SYSPARAM_ERR_FULL;
+            break;
+        }
+
+        if (max_key_id + new_keys > MAX_KEY_ID) {
+            debug(1, "out of ids!");
+            status = SYSPARAM_ERR_FULL;
+            break;
+        }
+
+        // Append all new keys and values in one pass
+        init_write_context(&write_ctx);
+        for (i = 0; i < count; i++) {
+            uint16_t key_len = strlen(items[i].key);
+            size_t value_len = items[i].value ? items[i].value_len : 0;
+            uint16_t binary_flag = items[i].binary ? ENTRY_FLAG_BINARY : 0;
+
+            if (state[i].changed && value_len) {
+                if (state[i].key_id < 0) {
+                    state[i].key_id = ++max_key_id;
+                    status = _write_entry(write_ctx.addr, state[i].key_id, (uint8_t *) items[i].key, key_len);
+                    if (status < 0) break;
+#if SYSPARAM_INDEX
+                    if (_sysparam_index.entries) {
+                        _index_add_key(items[i].key, key_len, state[i].key_id, write_ctx.addr);
+                    }
+#endif
+                    write_ctx.addr += ENTRY_SIZE(key_len);
+                    written_bytes += ENTRY_SIZE(key_len);
+                }
+
+                status = _write_entry(write_ctx.addr, state[i].key_id | ENTRY_FLAG_VALUE | binary_flag, items[i].value, value_len);
+                if (status < 0) break;
+#if SYSPARAM_INDEX
+                if (_sysparam_index.entries) {
+                    _index_set_value(items[i].key, key_len, state[i].key_id, write_ctx.addr);
+                }
+#endif
+                write_ctx.addr += ENTRY_SIZE(value_len);
+                written_bytes += ENTRY_SIZE(value_len);
+            }
+
+            written_items++;
+        }
+        _sysparam_info.end_addr = write_ctx.addr;
+
+        // Delete old values of all written items after new ones are in place,
+        // even if some item above failed.
+        for (i = 0; i < written_items; i++) {
+            if (state[i].changed && state[i].old_value_addr) {
+                sysparam_status_t delete_status = _delete_entry(state[i].old_value_addr);
+                if (delete_status < 0) {
+                    status = delete_status;
+                    break;
+                }
+                written_bytes += ENTRY_HEADER_SIZE;
+#if SYSPARAM_INDEX
+                if (_sysparam_index.entries && !(items[i].value && items[i].value_len)) {
+                    _index_set_value(items[i].key, strlen(items[i].key), state[i].key_id, 0);
+                }
+#endif
+            }
+        }
+
+        debug(1, "New addr is 0x%08x (%d bytes remaining, %d written)", _sysparam_info.end_addr, _sysparam_info.cur_base + _sysparam_info.region_size - _sysparam_info.end_addr, written_bytes);
+    } while (false);
+
+#if SYSPARAM_INDEX
+    if (status == SYSPARAM_ERR_IO) {
+        // Index can be out of sync with flash, so rebuild it
+        _index_build();
+    }
+#endif
+
+ done:
+    xSemaphoreGive(_sysparam_info.sem);
+
+    free(state);
+
+    if (written) *written = written_bytes;
+
+    return status;
+}
+
 sysparam_status_t sysparam_iter_start(sysparam_iter_t *iter) {
     if (!_sysparam_info.cur_base) return SYSPARAM_ERR_NOINIT;
 